@@ -1,15 +1,137 @@
 #include "basic.h"
+#include <cassert>
+#include <cstring>
 #include <iostream>
 #include <cmath>
+#include <stdexcept>
+#include <thread>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace bf {
 
+namespace {
+
+// the number of objects lookup_batch tests together
+size_t const lanes = 8;
+
+// the most partitions add_all spreads bit positions over, and the number of
+// objects it hashes and partitions at a time
+size_t const max_partitions = 256;
+size_t const add_chunk = size_t(1) << 18;
+
+// runs f(begin, end) on up to threads slices of [0, n)
+template <typename F>
+void parallel(size_t threads, size_t n, F f)
+{
+  threads = std::max<size_t>(1, std::min(threads, n));
+  if (threads == 1)
+  {
+    f(size_t(0), n);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t)
+    workers.emplace_back(f, n * t / threads, n * (t + 1) / threads);
+  for (auto& w : workers)
+    w.join();
+}
+
+// tests 8 objects against the blocks of a bit vector. pos holds k rows of 8
+// bit positions, one per object, the result has bit i set iff all k bits of
+// object i are set.
+uint8_t test_lanes_scalar(bitvector::block_type const* blocks,
+                          size_t const* pos, size_t k)
+{
+  uint64_t all[lanes];
+  for (size_t i = 0; i < lanes; ++i)
+    all[i] = 1;
+  for (size_t j = 0; j < k; ++j, pos += lanes)
+    for (size_t i = 0; i < lanes; ++i)
+      all[i] &= blocks[pos[i] / bitvector::bits_per_block]
+                >> (pos[i] % bitvector::bits_per_block);
+  uint8_t mask = 0;
+  for (size_t i = 0; i < lanes; ++i)
+    mask |= (all[i] & 1) << i;
+  return mask;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+uint8_t test_lanes_avx2(bitvector::block_type const* blocks,
+                        size_t const* pos, size_t k)
+{
+  auto base = reinterpret_cast<long long const*>(blocks);
+  auto low_bits = _mm256_set1_epi64x(bitvector::bits_per_block - 1);
+  // objects 0-3 and 4-7
+  auto lo = _mm256_set1_epi64x(1);
+  auto hi = lo;
+  for (size_t j = 0; j < k; ++j, pos += lanes)
+  {
+    auto p0 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pos));
+    auto p1 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pos + 4));
+    auto w0 = _mm256_i64gather_epi64(base, _mm256_srli_epi64(p0, 6), 8);
+    auto w1 = _mm256_i64gather_epi64(base, _mm256_srli_epi64(p1, 6), 8);
+    lo = _mm256_and_si256(lo, _mm256_srlv_epi64(w0, _mm256_and_si256(p0, low_bits)));
+    hi = _mm256_and_si256(hi, _mm256_srlv_epi64(w1, _mm256_and_si256(p1, low_bits)));
+  }
+  // bit 0 of every lane to its sign bit
+  auto m0 = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(lo, 63)));
+  auto m1 = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(hi, 63)));
+  return static_cast<uint8_t>(m0 | m1 << 4);
+}
+
+__attribute__((target("avx512f")))
+uint8_t test_lanes_avx512(bitvector::block_type const* blocks,
+                          size_t const* pos, size_t k)
+{
+  auto low_bits = _mm512_set1_epi64(bitvector::bits_per_block - 1);
+  auto one = _mm512_set1_epi64(1);
+  auto zero = _mm512_setzero_si512();
+  auto all = one;
+  for (size_t j = 0; j < k; ++j, pos += lanes)
+  {
+    // the masked forms, the plain ones trip -Wuninitialized in GCC 12 headers
+    auto p = _mm512_loadu_si512(pos);
+    auto w = _mm512_mask_i64gather_epi64(zero, 0xff, _mm512_maskz_srli_epi64(0xff, p, 6), blocks, 8);
+    all = _mm512_and_si512(all, _mm512_maskz_srlv_epi64(0xff, w, _mm512_and_si512(p, low_bits)));
+  }
+  return _mm512_test_epi64_mask(all, one);
+}
+#endif
+
+typedef uint8_t (*test_lanes_function)(bitvector::block_type const*,
+                                       size_t const*, size_t);
+
+test_lanes_function test_lanes()
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx512f"))
+    return test_lanes_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return test_lanes_avx2;
+#endif
+  return test_lanes_scalar;
+}
+
+} // namespace <anonymous>
+
+size_t const basic_bloom_filter::partition_bits;
+
 size_t basic_bloom_filter::m(double fp, size_t capacity)
 {
   auto ln2 = std::log(2);
   return std::ceil(-(capacity * std::log(fp) / ln2 / ln2));
 }
 
+size_t basic_bloom_filter::m(double fp, size_t capacity, size_t k)
+{
+  // fp = (1 - e^(-k n / m))^k solved for m
+  auto fill = std::pow(fp, 1.0 / k);
+  return std::ceil(-(k * static_cast<double>(capacity) / std::log1p(-fill)));
+}
+
 size_t basic_bloom_filter::k(size_t cells, size_t capacity)
 {
   auto frac = static_cast<double>(cells) / static_cast<double>(capacity);
@@ -23,19 +145,37 @@ basic_bloom_filter::basic_bloom_filter(hasher h, size_t cells)
 }
 
 basic_bloom_filter::basic_bloom_filter(double fp, size_t capacity, size_t seed,
-                                       bool double_hashing)
+                                       bool double_hashing, size_t k,
+                                       size_t salt, hash_family family)
 {
-  auto required_cells = m(fp, capacity);
+  auto required_cells = k == 0 ? m(fp, capacity) : m(fp, capacity, k);
   // auto optimal_k = k(required_cells, capacity);
-  auto optimal_k = 1;
-  std::cout << "Using " << optimal_k << " hash functions\n" << std::endl;
+  size_t optimal_k = k == 0 ? 1 : k;
   bits_.resize(required_cells);
-  hasher_ = make_hasher(optimal_k, seed, double_hashing);
+  if (double_hashing && optimal_k <= default_static_hasher::max_k)
+    static_hasher_ = make_static_hasher(optimal_k, seed, salt, family);
+  else
+  {
+    if (salt != 0)
+      throw std::invalid_argument("basic_bloom_filter: a salt needs double hashing and at most default_static_hasher::max_k hash functions");
+    hasher_ = make_hasher(optimal_k, seed, double_hashing, family);
+  }
+  k_ = optimal_k;
+  seed_ = seed;
+  salt_ = salt;
+  family_ = family;
+  double_hashing_ = double_hashing;
 }
 
 basic_bloom_filter::basic_bloom_filter(basic_bloom_filter&& other)
   : hasher_(std::move(other.hasher_)),
-    bits_(std::move(other.bits_))
+    static_hasher_(std::move(other.static_hasher_)),
+    bits_(std::move(other.bits_)),
+    k_(other.k_),
+    seed_(other.seed_),
+    salt_(other.salt_),
+    family_(other.family_),
+    double_hashing_(other.double_hashing_)
 {
 }
 
@@ -43,20 +183,139 @@ void basic_bloom_filter::add(object const& o)
 {
   //std::cout << "enter basic_bloom_filter::add" << std::endl;
   //std::cout << "cc" << std::endl;
+  if (static_hasher_)
+  {
+    digest d[default_static_hasher::max_k];
+    auto n = (*static_hasher_)(o, d);
+    for (size_t i = 0; i < n; ++i)
+      bits_.set(d[i] % bits_.size());
+    return;
+  }
   for (auto d : hasher_(o))
     bits_.set(d % bits_.size());
   //std::cout << "eee" << std::endl;
 }
 
+void basic_bloom_filter::add_concurrent(object const& o)
+{
+  if (static_hasher_)
+  {
+    digest d[default_static_hasher::max_k];
+    auto n = (*static_hasher_)(o, d);
+    for (size_t i = 0; i < n; ++i)
+      bits_.set_atomic(d[i] % bits_.size());
+    return;
+  }
+  for (auto d : hasher_(o))
+    bits_.set_atomic(d % bits_.size());
+}
+
 size_t basic_bloom_filter::lookup(object const& o) const
 {
   //std::cout << "Enter basic_bloom_filter::lookup" << std::endl;
+  if (static_hasher_)
+  {
+    digest d[default_static_hasher::max_k];
+    auto n = (*static_hasher_)(o, d);
+    for (size_t i = 0; i < n; ++i)
+      if (! bits_[d[i] % bits_.size()])
+        return 0;
+    return 1;
+  }
   for (auto d : hasher_(o))
     if (! bits_[d % bits_.size()])
       return 0;
   return 1;
 }
 
+void basic_bloom_filter::add_all(std::vector<object> const& objects,
+                                 size_t threads)
+{
+  auto size = bits_.size();
+  if (! static_hasher_ || size <= partition_bits)
+  {
+    for (auto& o : objects)
+      add(o);
+    return;
+  }
+  // a partition covers 2^shift cells, at least partition_bits
+  size_t shift = 0;
+  while ((partition_bits >> shift) > 1)
+    ++shift;
+  while (((size - 1) >> shift) >= max_partitions)
+    ++shift;
+  auto partitions = ((size - 1) >> shift) + 1;
+  auto k = static_hasher_->k();
+  auto blocks = bits_.data();
+  std::vector<size_t> positions;
+  std::vector<size_t> sorted;
+  std::vector<size_t> start(partitions + 1);
+  for (size_t base = 0; base < objects.size(); base += add_chunk)
+  {
+    auto n = std::min(add_chunk, objects.size() - base);
+    positions.resize(n * k);
+    parallel(threads, n, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+      {
+        digest d[default_static_hasher::max_k];
+        (*static_hasher_)(objects[base + i], d);
+        for (size_t j = 0; j < k; ++j)
+          positions[i * k + j] = d[j] % size;
+      }
+    });
+
+    // counting sort by partition
+    std::fill(start.begin(), start.end(), 0);
+    for (auto p : positions)
+      ++start[(p >> shift) + 1];
+    for (size_t i = 1; i <= partitions; ++i)
+      start[i] += start[i - 1];
+    sorted.resize(positions.size());
+    std::vector<size_t> next(start.begin(), start.end() - 1);
+    for (auto p : positions)
+      sorted[next[p >> shift]++] = p;
+
+    // a partition is a whole number of words, threads own disjoint words
+    parallel(threads, partitions, [&](size_t begin, size_t end) {
+      for (auto i = start[begin]; i < start[end]; ++i)
+      {
+        auto p = sorted[i];
+        blocks[p / bitvector::bits_per_block] |=
+          bitvector::block_type(1) << (p % bitvector::bits_per_block);
+      }
+    });
+  }
+}
+
+void basic_bloom_filter::lookup_batch(object const* objects, size_t n,
+                                      uint64_t* out) const
+{
+  static test_lanes_function const test = test_lanes();
+  std::memset(out, 0, (n + 63) / 64 * sizeof(uint64_t));
+  size_t i = 0;
+  if (static_hasher_ && bits_.size() > 0)
+  {
+    auto k = static_hasher_->k();
+    auto size = bits_.size();
+    digest d[default_static_hasher::max_k];
+    size_t pos[default_static_hasher::max_k * lanes];
+    // lanes divides 64, a group of objects sets bits of one word
+    for (; i + lanes <= n; i += lanes)
+    {
+      for (size_t lane = 0; lane < lanes; ++lane)
+      {
+        (*static_hasher_)(objects[i + lane], d);
+        for (size_t j = 0; j < k; ++j)
+          pos[j * lanes + lane] = d[j] % size;
+      }
+      out[i / 64] |= uint64_t(test(bits_.data(), pos, k)) << (i % 64);
+    }
+  }
+  for (; i < n; ++i)
+    if (lookup(objects[i]))
+      out[i / 64] |= uint64_t(1) << (i % 64);
+}
+
 void basic_bloom_filter::clear()
 {
   bits_.reset();
@@ -64,15 +323,40 @@ void basic_bloom_filter::clear()
 
 void basic_bloom_filter::remove(object const& o)
 {
+  if (static_hasher_)
+  {
+    digest d[default_static_hasher::max_k];
+    auto n = (*static_hasher_)(o, d);
+    for (size_t i = 0; i < n; ++i)
+      bits_.reset(d[i] % bits_.size());
+    return;
+  }
   for (auto d : hasher_(o))
     bits_.reset(d % bits_.size());
 }
 
+bool basic_bloom_filter::merge(basic_bloom_filter const& other)
+{
+  // the hash functions of a custom hasher are unknown, num_hashes() is 0
+  if (k_ == 0 || k_ != other.k_ || bits_.size() != other.bits_.size()
+      || seed_ != other.seed_ || salt_ != other.salt_
+      || family_ != other.family_ || double_hashing_ != other.double_hashing_)
+    return false;
+  bits_ |= other.bits_;
+  return true;
+}
+
 void basic_bloom_filter::swap(basic_bloom_filter& other)
 {
   using std::swap;
   swap(hasher_, other.hasher_);
+  swap(static_hasher_, other.static_hasher_);
   swap(bits_, other.bits_);
+  swap(k_, other.k_);
+  swap(seed_, other.seed_);
+  swap(salt_, other.salt_);
+  swap(family_, other.family_);
+  swap(double_hashing_, other.double_hashing_);
 }
 
 } // namespace bf
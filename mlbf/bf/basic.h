@@ -1,6 +1,7 @@
 #ifndef BF_BLOOM_FILTER_BASIC_H
 #define BF_BLOOM_FILTER_BASIC_H
 
+#include <cmath>
 #include <random>
 #include "bitvector.h"
 #include "bloom_filter.h"
@@ -26,6 +27,19 @@ public:
   /// elements.
   static size_t m(double fp, size_t capacity);
 
+  /// Computes the number of cells for a false-positive rate and capacity
+  /// when the filter uses a fixed number of hash functions.
+  ///
+  /// @param fp The desired false-positive rate
+  ///
+  /// @param capacity The maximum number of items.
+  ///
+  /// @param k The number of hash functions.
+  ///
+  /// @return The number of cells to use that guarantee *fp* for *capacity*
+  /// elements with *k* hash functions.
+  static size_t m(double fp, size_t capacity, size_t k);
+
   /// Computes @f$k^*@f$, the optimal number of hash functions for a given
   /// Bloom filter size (in terms of cells) and capacity.
   ///
@@ -53,8 +67,26 @@ public:
   ///
   /// @param double_hashing Flag indicating whether to use default or double
   /// hashing.
+  ///
+  /// @param k The number of hash functions. With 0 the filter is sized by
+  /// m(double, size_t) and uses a single hash function, otherwise it is
+  /// sized by m(double, size_t, size_t) for *k* hash functions.
+  ///
+  /// @param salt The salt the digests are remixed with, 0 for none, see
+  /// ::remix.
+  ///
+  /// @param family The family of the hash functions.
+  ///
+  /// @throws std::invalid_argument if *salt* is non-zero without double
+  /// hashing or with more than `default_static_hasher::max_k` hash functions,
+  /// whose ::hasher cannot remix digests.
+  ///
+  /// With double hashing and at most `default_static_hasher::max_k` hash
+  /// functions, the filter uses a ::default_static_hasher instead of a
+  /// ::hasher, so add and lookup neither allocate nor make type-erased calls.
   basic_bloom_filter(double fp, size_t capacity, size_t seed = 0,
-                     bool double_hashing = true);
+                     bool double_hashing = true, size_t k = 0,
+                     size_t salt = 0, hash_family family = hash_family::h3);
 
   basic_bloom_filter(basic_bloom_filter&&);
 
@@ -65,6 +97,48 @@ public:
   virtual size_t lookup(object const& o) const override;
   virtual void clear() override;
 
+  /// Adds objects in bulk. The bit positions of the objects are hashed
+  /// first and partitioned by range of the bit vector, then every partition
+  /// is applied at once, so its part of the bit vector stays in cache while
+  /// it is updated. A filter of at most ::partition_bits cells is small
+  /// enough to add the objects one at a time.
+  ///
+  /// @param objects The objects to add.
+  ///
+  /// @param threads The number of threads that hash the objects and apply
+  /// the partitions. Partitions do not share words, so no bit update is
+  /// atomic.
+  void add_all(std::vector<object> const& objects, size_t threads = 1);
+
+  /// The number of cells add_all() applies together at most, 256 KB.
+  static size_t const partition_bits = size_t(1) << 21;
+
+  /// Looks up objects in bulk.
+  ///
+  /// With a ::default_static_hasher the objects are hashed one at a time and
+  /// the bits of 8 objects are gathered and tested together, in vector
+  /// registers if the processor has AVX-512 or AVX2.
+  ///
+  /// @param objects The objects to look up.
+  ///
+  /// @param n The number of objects.
+  ///
+  /// @param out `(n + 63) / 64` words. Bit `i % 64` of `out[i / 64]` is set
+  /// iff `lookup(objects[i])` is not 0.
+  void lookup_batch(object const* objects, size_t n, uint64_t* out) const;
+
+  /// Adds an object with atomic bit updates. Several threads may call this
+  /// concurrently, but not together with any other operation.
+  /// @param o The object to add.
+  void add_concurrent(object const& o);
+
+  /// Adds an element with atomic bit updates, see add_concurrent(object const&).
+  template <typename T>
+  void add_concurrent(T const& x)
+  {
+    add_concurrent(wrap(x));
+  }
+
   /// Removes an object from the Bloom filter.
   /// May introduce false negatives because the bitvector indices of the object
   /// to remove may be shared with other objects.
@@ -72,6 +146,30 @@ public:
   /// @param o The object to remove.
   void remove(object const& o);
 
+  /// Adds the objects of another filter, the union of the two. Filters of
+  /// shards of a key set built by different threads or hosts combine to the
+  /// filter of the whole set.
+  ///
+  /// @param other A filter of the same shape: the same number of cells, hash
+  /// functions, seed, salt, family and double hashing.
+  ///
+  /// @return `false` and the filter unchanged if the shapes differ or either
+  /// filter was constructed from a custom hasher.
+  bool merge(basic_bloom_filter const& other);
+
+  /// Computes the fraction of cells set, a sizing diagnostic.
+  double fill_ratio() const
+  {
+    return bits_.size() == 0 ? 0 : static_cast<double>(bits_.count()) / bits_.size();
+  }
+
+  /// Estimates the false-positive rate from the fill ratio, the chance that
+  /// all *k* bits of an object not added are set.
+  double estimated_fp() const
+  {
+    return std::pow(fill_ratio(), static_cast<double>(k_));
+  }
+
   /// Swaps two basic Bloom filters.
   /// @param other The other basic Bloom filter.
   void swap(basic_bloom_filter& other);
@@ -79,9 +177,54 @@ public:
   size_t size() {
     return std::ceil(bits_.size() / 8.0); 
   }
+
+  /// Retrieves the number of hash functions.
+  /// @return The number of hash functions, or 0 if the filter was constructed
+  /// from a custom hasher.
+  size_t num_hashes() const
+  {
+    return k_;
+  }
+
+  /// Retrieves the seed the hash functions were derived from by ::make_hasher.
+  size_t seed() const
+  {
+    return seed_;
+  }
+
+  /// Retrieves the salt the digests are remixed with.
+  size_t salt() const
+  {
+    return salt_;
+  }
+
+  /// Retrieves the family of the hash functions.
+  hash_family family() const
+  {
+    return family_;
+  }
+
+  /// Checks whether the filter uses double hashing.
+  bool double_hashing() const
+  {
+    return double_hashing_;
+  }
+
+  /// Retrieves the underlying bit vector.
+  bitvector const& storage() const
+  {
+    return bits_;
+  }
+
 private:
   hasher hasher_;
+  std::unique_ptr<default_static_hasher> static_hasher_;
   bitvector bits_;
+  size_t k_ = 0;
+  size_t seed_ = 0;
+  size_t salt_ = 0;
+  hash_family family_ = hash_family::h3;
+  bool double_hashing_ = false;
 };
 
 } // namespace bf
@@ -1,6 +1,10 @@
 #include "bitvector.h"
 
+#include <algorithm>
 #include <cassert>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace bf {
 
@@ -24,6 +28,164 @@ uint8_t count_table[] =
   6, 7, 6, 7, 7, 8
 };
 
+// the block-wise operations, x op= y
+enum combine_op { op_and, op_or, op_xor, op_sub };
+
+template <int Op>
+block_type combine_block(block_type x, block_type y)
+{
+  return Op == op_and ? x & y : Op == op_or ? x | y : Op == op_xor ? x ^ y : x & ~y;
+}
+
+typedef void (*combine_function)(block_type*, block_type const*, size_type);
+typedef size_type (*count_function)(block_type const*, size_type);
+
+template <int Op>
+void combine_scalar(block_type* x, block_type const* y, size_type n)
+{
+  for (size_type i = 0; i < n; ++i)
+    x[i] = combine_block<Op>(x[i], y[i]);
+}
+
+size_type count_scalar(block_type const* x, size_type n)
+{
+  size_type c = 0;
+  for (size_type i = 0; i < n; ++i)
+  {
+    auto block = x[i];
+    while (block)
+    {
+      c += count_table[block & ((1u << 8) - 1)];
+      block >>= 8;
+    }
+  }
+  return c;
+}
+
+#if defined(__x86_64__)
+template <int Op>
+__attribute__((target("avx2")))
+void combine_avx2(block_type* x, block_type const* y, size_type n)
+{
+  size_type i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    auto a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(x + i));
+    auto b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(y + i));
+    a = Op == op_and ? _mm256_and_si256(a, b)
+      : Op == op_or ? _mm256_or_si256(a, b)
+      : Op == op_xor ? _mm256_xor_si256(a, b)
+      : _mm256_andnot_si256(b, a);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i), a);
+  }
+  for (; i < n; ++i)
+    x[i] = combine_block<Op>(x[i], y[i]);
+}
+
+template <int Op>
+__attribute__((target("avx512f")))
+void combine_avx512(block_type* x, block_type const* y, size_type n)
+{
+  size_type i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    auto a = _mm512_loadu_si512(x + i);
+    auto b = _mm512_loadu_si512(y + i);
+    a = Op == op_and ? _mm512_and_si512(a, b)
+      : Op == op_or ? _mm512_or_si512(a, b)
+      : Op == op_xor ? _mm512_xor_si512(a, b)
+      : _mm512_maskz_andnot_epi64(0xff, b, a);  // the plain form trips -Wuninitialized in GCC 12
+    _mm512_storeu_si512(x + i, a);
+  }
+  for (; i < n; ++i)
+    x[i] = combine_block<Op>(x[i], y[i]);
+}
+
+__attribute__((target("popcnt")))
+size_type count_popcnt(block_type const* x, size_type n)
+{
+  size_type c = 0;
+  for (size_type i = 0; i < n; ++i)
+    c += __builtin_popcountll(x[i]);
+  return c;
+}
+
+// counts the nibbles of every byte with a shuffle, then sums the bytes of
+// every 64-bit lane
+__attribute__((target("avx2,popcnt")))
+size_type count_avx2(block_type const* x, size_type n)
+{
+  auto table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  auto nibble = _mm256_set1_epi8(0x0f);
+  auto zero = _mm256_setzero_si256();
+  auto sum = zero;
+  size_type i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(x + i));
+    auto lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+    auto hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero));
+  }
+  size_type c = _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1)
+    + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+  for (; i < n; ++i)
+    c += __builtin_popcountll(x[i]);
+  return c;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+size_type count_avx512(block_type const* x, size_type n)
+{
+  auto sum = _mm512_setzero_si512();
+  size_type i = 0;
+  for (; i + 8 <= n; i += 8)
+    sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(_mm512_loadu_si512(x + i)));
+  uint64_t lanes[8];
+  _mm512_storeu_si512(lanes, sum);
+  size_type c = 0;
+  for (auto lane : lanes)
+    c += lane;
+  for (; i < n; ++i)
+    c += __builtin_popcountll(x[i]);
+  return c;
+}
+#endif
+
+// the fastest kernels the processor runs, picked once
+template <int Op>
+combine_function combine_kernel()
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx512f"))
+    return combine_avx512<Op>;
+  if (__builtin_cpu_supports("avx2"))
+    return combine_avx2<Op>;
+#endif
+  return combine_scalar<Op>;
+}
+
+count_function count_kernel()
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx512vpopcntdq"))
+    return count_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return count_avx2;
+  if (__builtin_cpu_supports("popcnt"))
+    return count_popcnt;
+#endif
+  return count_scalar;
+}
+
+template <int Op>
+void combine(block_type* x, block_type const* y, size_type n)
+{
+  static combine_function const kernel = combine_kernel<Op>();
+  kernel(x, y, n);
+}
+
 } // namespace <anonymous>
 
 bitvector::reference::reference(block_type& block, block_type i)
@@ -215,32 +377,30 @@ bitvector& bitvector::operator>>=(size_type n)
 bitvector& bitvector::operator&=(bitvector const& other)
 {
   assert(size() >= other.size());
-  for (size_type i = 0; i < blocks(); ++i)
-    bits_[i] &= other.bits_[i];
+  // the blocks past the end of other are and-ed with 0
+  combine<op_and>(bits_.data(), other.bits_.data(), other.blocks());
+  std::fill(bits_.begin() + other.blocks(), bits_.end(), 0);
   return *this;
 }
 
 bitvector& bitvector::operator|=(bitvector const& other)
 {
   assert(size() >= other.size());
-  for (size_type i = 0; i < blocks(); ++i)
-    bits_[i] |= other.bits_[i];
+  combine<op_or>(bits_.data(), other.bits_.data(), other.blocks());
   return *this;
 }
 
 bitvector& bitvector::operator^=(bitvector const& other)
 {
   assert(size() >= other.size());
-  for (size_type i = 0; i < blocks(); ++i)
-    bits_[i] ^= other.bits_[i];
+  combine<op_xor>(bits_.data(), other.bits_.data(), other.blocks());
   return *this;
 }
 
 bitvector& bitvector::operator-=(bitvector const& other)
 {
   assert(size() >= other.size());
-  for (size_type i = 0; i < blocks(); ++i)
-    bits_[i] &= ~other.bits_[i];
+  combine<op_sub>(bits_.data(), other.bits_.data(), other.blocks());
   return *this;
 }
 
@@ -337,6 +497,12 @@ void bitvector::append(block_type block)
   num_bits_ += bits_per_block;
 }
 
+void bitvector::set_atomic(size_type i)
+{
+  assert(i < num_bits_);
+  __atomic_fetch_or(&bits_[block_index(i)], bit_mask(i), __ATOMIC_RELAXED);
+}
+
 bitvector& bitvector::set(size_type i, bool bit)
 {
   assert(i < num_bits_);
@@ -398,22 +564,8 @@ bitvector::reference bitvector::operator[](size_type i)
 
 size_type bitvector::count() const
 {
-  auto first = bits_.begin();
-  size_t n = 0;
-  auto length = blocks();
-  while (length)
-  {
-    auto block = *first;
-    while (block)
-    {
-      // TODO: use __popcnt if available.
-      n += count_table[block & ((1u << 8) - 1)];
-      block >>= 8;
-    }
-    ++first;
-    --length;
-  }
-  return n;
+  static count_function const kernel = count_kernel();
+  return kernel(bits_.data(), blocks());
 }
 
 size_type bitvector::blocks() const
@@ -421,6 +573,16 @@ size_type bitvector::blocks() const
   return bits_.size();
 }
 
+block_type const* bitvector::data() const
+{
+  return bits_.data();
+}
+
+block_type* bitvector::data()
+{
+  return bits_.data();
+}
+
 size_type bitvector::size() const
 {
   return num_bits_;
@@ -91,6 +91,9 @@ public:
   bitvector operator>>(size_type n) const;
   bitvector& operator<<=(size_type n);
   bitvector& operator>>=(size_type n);
+
+  /// The compound operations and count() run on whole blocks, with AVX-512
+  /// or AVX2 kernels where the processor has them.
   bitvector& operator&=(bitvector const& other);
   bitvector& operator|=(bitvector const& other);
   bitvector& operator^=(bitvector const& other);
@@ -171,6 +174,11 @@ public:
   /// @return A reference to the bit vector instance.
   bitvector& set(size_type i, bool bit = true);
 
+  /// Sets a bit to 1 with an atomic fetch-or on its block, so several
+  /// threads may set bits of the same bit vector at once.
+  /// @param i The bit position.
+  void set_atomic(size_type i);
+
   /// Sets all bits to 1.
   /// @return A reference to the bit vector instance.
   bitvector& set();
@@ -212,6 +220,12 @@ public:
   /// @param The number of blocks that represent `size()` bits.
   size_type blocks() const;
 
+  /// Retrieves the underlying storage.
+  /// @return A pointer to the `blocks()` blocks of the bit vector. Bit *i* is
+  /// bit `bit_index(i)` of block `block_index(i)`.
+  block_type const* data() const;
+  block_type* data();
+
   /// Retrieves the number of bits the bitvector consist of.
   /// @return The length of the bit vector in bits.
   size_type size() const;
@@ -0,0 +1,175 @@
+#include "blocked.h"
+#include "basic.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace bf {
+
+namespace {
+
+size_t seed_of(size_t seed)
+{
+  std::minstd_rand0 prng(seed);
+  return prng();
+}
+
+// tests a block against a mask, true iff no bit of the mask is clear in the block
+bool test_scalar(uint64_t const* block, uint64_t const* mask)
+{
+  uint64_t miss = 0;
+  for (size_t i = 0; i < blocked_bloom_filter::block_words; ++i)
+    miss |= mask[i] & ~block[i];
+  return miss == 0;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+bool test_avx2(uint64_t const* block, uint64_t const* mask)
+{
+  auto b0 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block));
+  auto b1 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block + 4));
+  auto m0 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(mask));
+  auto m1 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(mask + 4));
+  // testc is 1 iff ~b & m is zero
+  return _mm256_testc_si256(b0, m0) & _mm256_testc_si256(b1, m1);
+}
+
+__attribute__((target("avx512f")))
+bool test_avx512(uint64_t const* block, uint64_t const* mask)
+{
+  auto b = _mm512_loadu_si512(block);
+  auto m = _mm512_loadu_si512(mask);
+  // the masked form, the plain one trips -Wuninitialized in GCC 12 headers
+  auto miss = _mm512_maskz_andnot_epi64(0xff, b, m);
+  return _mm512_test_epi64_mask(miss, miss) == 0;
+}
+#endif
+
+typedef bool (*test_function)(uint64_t const*, uint64_t const*);
+
+test_function test_kernel()
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx512f"))
+    return test_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return test_avx2;
+#endif
+  return test_scalar;
+}
+
+} // namespace <anonymous>
+
+size_t const blocked_bloom_filter::block_bits;
+size_t const blocked_bloom_filter::block_words;
+size_t const blocked_bloom_filter::max_k;
+
+double blocked_bloom_filter::fp(size_t cells, size_t capacity, size_t k)
+{
+  if (capacity == 0)
+    return 0;
+  // a block holds Poisson(lambda) elements, sum the basic filter
+  // false-positive rate of a block over the load
+  auto lambda = static_cast<double>(capacity) * block_bits / cells;
+  auto spread = 10 * std::sqrt(lambda) + 10;
+  auto first = static_cast<size_t>(std::max(0.0, lambda - spread));
+  auto last = static_cast<size_t>(lambda + spread);
+  double sum = 0;
+  double total = 0;
+  for (size_t load = first; load <= last; ++load)
+  {
+    auto p = std::exp(load * std::log(lambda) - lambda - std::lgamma(load + 1.0));
+    auto empty = std::pow(1.0 - 1.0 / block_bits, static_cast<double>(k * load));
+    sum += p * std::pow(1.0 - empty, static_cast<double>(k));
+    total += p;
+  }
+  return sum / total;
+}
+
+size_t blocked_bloom_filter::m(double fp, size_t capacity, size_t k)
+{
+  auto cells = std::max(basic_bloom_filter::m(fp, capacity), block_bits);
+  cells = (cells + block_bits - 1) / block_bits * block_bits;
+  auto step = std::max(block_bits, cells / 64 / block_bits * block_bits);
+  while (blocked_bloom_filter::fp(cells, capacity, k) > fp)
+    cells += step;
+  return cells;
+}
+
+blocked_bloom_filter::blocked_bloom_filter(double fp, size_t capacity,
+                                           size_t k, size_t seed, size_t salt,
+                                           hash_family family)
+  : seed_(seed),
+    salt_(salt),
+    hash_(family, seed_of(seed))
+{
+  if (k == 0)
+  {
+    auto cells = basic_bloom_filter::m(fp, capacity);
+    k = std::max<size_t>(1, basic_bloom_filter::k(cells, capacity));
+  }
+  k_ = std::min(k, max_k);
+  blocks_ = m(fp, capacity, k_) / block_bits;
+  words_.assign(blocks_ * block_words + block_words - 1, 0);
+  auto misalign = reinterpret_cast<uintptr_t>(words_.data()) % 64;
+  offset_ = misalign == 0 ? 0 : (64 - misalign) / sizeof(uint64_t);
+}
+
+blocked_bloom_filter::blocked_bloom_filter(blocked_bloom_filter&& other)
+  : k_(other.k_),
+    seed_(other.seed_),
+    salt_(other.salt_),
+    blocks_(other.blocks_),
+    hash_(std::move(other.hash_)),
+    words_(std::move(other.words_)),
+    offset_(other.offset_)
+{
+}
+
+bool blocked_bloom_filter::test(uint64_t const* block, uint64_t const* mask)
+{
+  static test_function const kernel = test_kernel();
+  return kernel(block, mask);
+}
+
+void blocked_bloom_filter::add(object const& o)
+{
+  auto d = remix(hash_(o), salt_);
+  uint64_t mask[block_words];
+  make_mask(d, k_, mask);
+  auto b = block(block_of(d, blocks_));
+  for (size_t i = 0; i < block_words; ++i)
+    b[i] |= mask[i];
+}
+
+void blocked_bloom_filter::add_concurrent(object const& o)
+{
+  auto d = remix(hash_(o), salt_);
+  uint64_t mask[block_words];
+  make_mask(d, k_, mask);
+  auto b = block(block_of(d, blocks_));
+  for (size_t i = 0; i < block_words; ++i)
+    if (mask[i])
+      __atomic_fetch_or(&b[i], mask[i], __ATOMIC_RELAXED);
+}
+
+size_t blocked_bloom_filter::lookup(object const& o) const
+{
+  auto d = remix(hash_(o), salt_);
+  uint64_t mask[block_words];
+  make_mask(d, k_, mask);
+  return test(block(block_of(d, blocks_)), mask) ? 1 : 0;
+}
+
+void blocked_bloom_filter::clear()
+{
+  std::fill(words_.begin(), words_.end(), 0);
+}
+
+} // namespace bf
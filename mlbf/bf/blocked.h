@@ -0,0 +1,207 @@
+#ifndef BF_BLOOM_FILTER_BLOCKED_H
+#define BF_BLOOM_FILTER_BLOCKED_H
+
+#include <cstdint>
+#include <vector>
+#include "bloom_filter.h"
+#include "hash.h"
+
+namespace bf {
+
+/// A cache-line blocked Bloom filter. The first hash picks one 512-bit
+/// block, and all *k* bits of an object are set inside that block, so a
+/// lookup touches a single cache line no matter how large *k* is. The *k*
+/// bits form a 512-bit mask that is tested against the block with one
+/// AVX-512 mask compare, two AVX2 ones, or word by word on other CPUs.
+///
+/// A key is hashed once; the block index and the *k* bit positions
+/// are derived from that digest remixed with a salt, see ::remix.
+///
+/// @note For the same number of bits a blocked filter has a slightly higher
+/// false-positive rate than a ::basic_bloom_filter, because the load of the
+/// blocks varies. m() accounts for this.
+class blocked_bloom_filter : public bloom_filter
+{
+public:
+  /// The number of bits in a block, one cache line.
+  static size_t const block_bits = 512;
+
+  /// The number of 64-bit words in a block.
+  static size_t const block_words = block_bits / 64;
+
+  /// The maximum number of hash functions.
+  static size_t const max_k = 16;
+
+  /// Computes the false-positive rate of a blocked Bloom filter.
+  ///
+  /// @param cells The number of cells, a multiple of ::block_bits.
+  ///
+  /// @param capacity The number of elements.
+  ///
+  /// @param k The number of hash functions.
+  ///
+  /// @return The expected false-positive rate, averaged over the Poisson
+  /// distributed block loads.
+  static double fp(size_t cells, size_t capacity, size_t k);
+
+  /// Computes the number of cells for a false-positive rate and capacity.
+  ///
+  /// @param fp The desired false-positive rate.
+  ///
+  /// @param capacity The maximum number of items.
+  ///
+  /// @param k The number of hash functions.
+  ///
+  /// @return The smallest multiple of ::block_bits cells, up to 1/64 of the
+  /// size, that guarantees *fp* for *capacity* elements.
+  static size_t m(double fp, size_t capacity, size_t k);
+
+  /// Remixes the digest of an object with the salt of a filter.
+  /// @param d The digest of an object.
+  /// @param salt The salt of the filter.
+  /// @return The digest that block_of() and make_mask() take.
+  static uint64_t remix(digest d, size_t salt)
+  {
+    return bf::remix(d, salt);
+  }
+
+  /// Computes the block of a remixed digest.
+  /// @param x The remixed digest of an object.
+  /// @param blocks The number of blocks.
+  /// @return The index of the block in `[0, blocks)`.
+  static size_t block_of(uint64_t x, size_t blocks)
+  {
+    return static_cast<size_t>((static_cast<unsigned __int128>(x) * blocks) >> 64);
+  }
+
+  /// Computes the in-block mask of a remixed digest.
+  /// @param x The remixed digest of an object.
+  /// @param k The number of bits to set.
+  /// @param mask The ::block_words words of the mask.
+  static void make_mask(uint64_t x, size_t k, uint64_t* mask)
+  {
+    for (size_t i = 0; i < block_words; ++i)
+      mask[i] = 0;
+    // the block index uses the high bits of x, scramble them before taking positions
+    x ^= x >> 29;
+    for (size_t i = 0; i < k; ++i)
+    {
+      x *= 0x9e3779b97f4a7c15ULL;
+      auto pos = x >> 55;  // 9 bits: a position in the block
+      mask[pos >> 6] |= uint64_t(1) << (pos & 63);
+    }
+  }
+
+  /// Tests a block against a mask. The kernel is picked for the CPU on
+  /// first use.
+  /// @param block The ::block_words words of a block.
+  /// @param mask The ::block_words words of a mask.
+  /// @return `true` iff every bit of *mask* is set in *block*.
+  static bool test(uint64_t const* block, uint64_t const* mask);
+
+  /// Constructs a blocked Bloom filter by given a desired false-positive
+  /// probability and an expected number of elements.
+  ///
+  /// @param fp The desired false-positive probability.
+  ///
+  /// @param capacity The desired number of elements.
+  ///
+  /// @param k The number of hash functions. 0 picks the optimal value of a
+  /// basic Bloom filter of the same *fp*.
+  ///
+  /// @param seed The seed of the hash function. The function is the first
+  /// one ::make_hasher would create with this seed.
+  ///
+  /// @param salt The salt the digest is remixed with.
+  ///
+  /// @param family The family of the hash function.
+  blocked_bloom_filter(double fp, size_t capacity, size_t k = 0,
+                       size_t seed = 0, size_t salt = 0,
+                       hash_family family = hash_family::h3);
+
+  blocked_bloom_filter(blocked_bloom_filter&&);
+
+  using bloom_filter::add;
+  using bloom_filter::lookup;
+
+  virtual void add(object const& o) override;
+  virtual size_t lookup(object const& o) const override;
+  virtual void clear() override;
+
+  /// Adds an object with atomic bit updates. Several threads may call this
+  /// concurrently, but not together with any other operation.
+  /// @param o The object to add.
+  void add_concurrent(object const& o);
+
+  template <typename T>
+  void add_concurrent(T const& x)
+  {
+    add_concurrent(wrap(x));
+  }
+
+  /// Retrieves the size in bytes.
+  size_t size() const
+  {
+    return blocks_ * block_bits / 8;
+  }
+
+  /// Retrieves the number of hash functions.
+  size_t num_hashes() const
+  {
+    return k_;
+  }
+
+  /// Retrieves the seed of the hash function.
+  size_t seed() const
+  {
+    return seed_;
+  }
+
+  /// Retrieves the salt the digests are remixed with.
+  size_t salt() const
+  {
+    return salt_;
+  }
+
+  /// Retrieves the family of the hash function.
+  hash_family family() const
+  {
+    return hash_.family();
+  }
+
+  /// Retrieves the number of blocks.
+  size_t blocks() const
+  {
+    return blocks_;
+  }
+
+  /// Retrieves the blocks, aligned to 64 bytes.
+  /// @return A pointer to `blocks() * block_words` words.
+  uint64_t const* data() const
+  {
+    return words_.data() + offset_;
+  }
+
+private:
+  uint64_t* block(size_t i)
+  {
+    return words_.data() + offset_ + i * block_words;
+  }
+
+  uint64_t const* block(size_t i) const
+  {
+    return words_.data() + offset_ + i * block_words;
+  }
+
+  size_t k_;
+  size_t seed_;
+  size_t salt_;
+  size_t blocks_;
+  family_hash_function hash_;
+  std::vector<uint64_t> words_;  ///< blocks_ blocks and room for alignment
+  size_t offset_;                ///< first word of block 0 in words_
+};
+
+} // namespace bf
+
+#endif
@@ -0,0 +1,57 @@
+#include "fingerprint.h"
+
+#include <algorithm>
+#include <random>
+
+namespace bf {
+
+namespace {
+
+size_t seed_of(size_t seed)
+{
+  std::minstd_rand0 prng(seed);
+  return prng();
+}
+
+} // namespace <anonymous>
+
+fingerprint_set::fingerprint_set(size_t seed, size_t salt, hash_family family)
+  : seed_(seed),
+    salt_(salt),
+    hash_(family, seed_of(seed))
+{
+}
+
+fingerprint_set::fingerprint_set(fingerprint_set&& other)
+  : seed_(other.seed_),
+    salt_(other.salt_),
+    hash_(std::move(other.hash_)),
+    fps_(std::move(other.fps_))
+{
+}
+
+void fingerprint_set::add(object const& o)
+{
+  auto x = fingerprint(hash_(o), salt_);
+  fps_.insert(std::upper_bound(fps_.begin(), fps_.end(), x), x);
+}
+
+void fingerprint_set::add_all(std::vector<object> const& objects)
+{
+  fps_.reserve(fps_.size() + objects.size());
+  for (auto& o : objects)
+    fps_.push_back(fingerprint(hash_(o), salt_));
+  std::sort(fps_.begin(), fps_.end());
+}
+
+size_t fingerprint_set::lookup(object const& o) const
+{
+  return find(fps_.data(), fps_.size(), fingerprint(hash_(o), salt_)) ? 1 : 0;
+}
+
+void fingerprint_set::clear()
+{
+  fps_.clear();
+}
+
+} // namespace bf
@@ -0,0 +1,114 @@
+#ifndef BF_BLOOM_FILTER_FINGERPRINT_H
+#define BF_BLOOM_FILTER_FINGERPRINT_H
+
+#include <cstdint>
+#include <vector>
+#include "bloom_filter.h"
+#include "hash.h"
+
+namespace bf {
+
+/// A sorted array of 64-bit fingerprints. Unlike a Bloom filter it has no
+/// false positives among a known set of objects once no fingerprint of that
+/// set collides, which the caller checks and fixes by changing the seed.
+/// A lookup is a binary search, so the set is meant for few objects, such
+/// as the last level of a filter cascade.
+///
+/// A fingerprint is the digest remixed with the salt, see ::remix.
+class fingerprint_set : public bloom_filter
+{
+public:
+  /// Computes the fingerprint of a digest.
+  /// @param d The digest of an object.
+  /// @param salt The salt of the set.
+  static uint64_t fingerprint(digest d, size_t salt)
+  {
+    return remix(d, salt);
+  }
+
+  /// Searches a sorted fingerprint array.
+  /// @param fps The fingerprints in ascending order.
+  /// @param n The number of fingerprints.
+  /// @param x The fingerprint to find.
+  static bool find(uint64_t const* fps, size_t n, uint64_t x)
+  {
+    while (n > 1)
+    {
+      auto half = n / 2;
+      fps = fps[half] <= x ? fps + half : fps;
+      n -= half;
+    }
+    return n == 1 && *fps == x;
+  }
+
+  /// Constructs an empty fingerprint set.
+  ///
+  /// @param seed The seed of the hash function. The function is the first
+  /// one ::make_hasher would create with this seed.
+  ///
+  /// @param salt The salt the digest is remixed with.
+  ///
+  /// @param family The family of the hash function.
+  fingerprint_set(size_t seed = 0, size_t salt = 0,
+                  hash_family family = hash_family::h3);
+
+  fingerprint_set(fingerprint_set&&);
+
+  using bloom_filter::add;
+  using bloom_filter::lookup;
+
+  /// Adds an object, keeping the fingerprints sorted.
+  virtual void add(object const& o) override;
+  virtual size_t lookup(object const& o) const override;
+  virtual void clear() override;
+
+  /// Adds objects in bulk, sorting once.
+  /// @param objects The objects to add.
+  void add_all(std::vector<object> const& objects);
+
+  /// Retrieves the size in bytes.
+  size_t size() const
+  {
+    return fps_.size() * sizeof(uint64_t);
+  }
+
+  /// Retrieves the number of fingerprints.
+  size_t count() const
+  {
+    return fps_.size();
+  }
+
+  /// Retrieves the seed of the hash function.
+  size_t seed() const
+  {
+    return seed_;
+  }
+
+  /// Retrieves the salt the digests are remixed with.
+  size_t salt() const
+  {
+    return salt_;
+  }
+
+  /// Retrieves the family of the hash function.
+  hash_family family() const
+  {
+    return hash_.family();
+  }
+
+  /// Retrieves the fingerprints in ascending order.
+  uint64_t const* data() const
+  {
+    return fps_.data();
+  }
+
+private:
+  size_t seed_;
+  size_t salt_;
+  family_hash_function hash_;
+  std::vector<uint64_t> fps_;
+};
+
+} // namespace bf
+
+#endif
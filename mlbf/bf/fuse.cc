@@ -0,0 +1,185 @@
+#include "fuse.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+namespace bf {
+
+namespace {
+
+size_t seed_of(size_t seed)
+{
+  std::minstd_rand0 prng(seed);
+  return prng();
+}
+
+} // namespace <anonymous>
+
+size_t binary_fuse_filter::fingerprint_bits(double fp)
+{
+  size_t const limit = max_bits;
+  if (fp >= 0.5)
+    return 1;
+  auto bits = static_cast<size_t>(std::ceil(-std::log2(fp) - 1e-9));
+  return std::max<size_t>(1, std::min(bits, limit));
+}
+
+size_t binary_fuse_filter::segment_length_for(size_t capacity)
+{
+  if (capacity <= 1)
+    return 4;
+  auto log = std::floor(std::log(static_cast<double>(capacity)) / std::log(3.33)
+                        + 2.25);
+  return std::min<size_t>(size_t(1) << static_cast<int>(log), 262144);
+}
+
+size_t binary_fuse_filter::slots(size_t capacity)
+{
+  auto length = segment_length_for(capacity);
+  // the slots per object fall from about 1.4 for a thousand objects to 1.125
+  auto factor = capacity <= 1 ? 0.0 : std::max(
+    1.125, 0.875 + 0.25 * std::log(1e6) / std::log(static_cast<double>(capacity)));
+  auto total = static_cast<size_t>(std::round(capacity * factor));
+  auto segments = (total + length - 1) / length;
+  segments = segments > 2 ? segments - 2 : 1;
+  return (segments + 2) * length;
+}
+
+binary_fuse_filter::binary_fuse_filter(double fp, size_t capacity, size_t seed,
+                                       size_t salt, hash_family family)
+  : bits_(fingerprint_bits(fp)),
+    capacity_(capacity),
+    seed_(seed),
+    salt_(salt),
+    hash_(family, seed_of(seed))
+{
+  digests_.reserve(capacity);
+}
+
+binary_fuse_filter::binary_fuse_filter(binary_fuse_filter&& other)
+  : bits_(other.bits_),
+    capacity_(other.capacity_),
+    seed_(other.seed_),
+    salt_(other.salt_),
+    slots_(other.slots_),
+    segment_length_(other.segment_length_),
+    built_(other.built_),
+    hash_(std::move(other.hash_)),
+    digests_(std::move(other.digests_)),
+    words_(std::move(other.words_))
+{
+}
+
+void binary_fuse_filter::add(object const& o)
+{
+  digests_.push_back(hash_(o));
+  if (built_)
+    build();
+}
+
+size_t binary_fuse_filter::lookup(object const& o) const
+{
+  assert(built_);
+  return test(words_.data(), bits_, segment_length_,
+              slots_ - 2 * segment_length_, remix(hash_(o), salt_)) ? 1 : 0;
+}
+
+void binary_fuse_filter::clear()
+{
+  digests_.clear();
+  words_.clear();
+  slots_ = 0;
+  segment_length_ = 0;
+  built_ = false;
+}
+
+void binary_fuse_filter::build()
+{
+  // equal digests never peel, and they are one object to the filter anyway
+  std::sort(digests_.begin(), digests_.end());
+  digests_.erase(std::unique(digests_.begin(), digests_.end()), digests_.end());
+  auto capacity = std::max(capacity_, digests_.size());
+  slots_ = slots(capacity);
+  segment_length_ = segment_length_for(capacity);
+  std::vector<uint64_t> xs(digests_.size());
+  for (;; salt_ += salt_step)
+  {
+    for (size_t i = 0; i < digests_.size(); ++i)
+      xs[i] = remix(digests_[i], salt_);
+    if (solve(xs))
+      break;
+  }
+  built_ = true;
+}
+
+bool binary_fuse_filter::solve(std::vector<uint64_t> const& xs)
+{
+  auto segment_count_length = slots_ - 2 * segment_length_;
+  // every slot keeps the number of digests mapped to it, shifted left by two,
+  // the XOR of its index among their three slots, and the XOR of the digests
+  std::vector<uint32_t> count(slots_, 0);
+  std::vector<uint64_t> xored(slots_, 0);
+  size_t h[3];
+  for (auto x : xs)
+  {
+    positions(x, segment_length_, segment_count_length, h);
+    for (uint32_t j = 0; j < 3; ++j)
+    {
+      count[h[j]] = (count[h[j]] + 4) ^ j;
+      xored[h[j]] ^= x;
+    }
+  }
+
+  // peel the digests that are alone in a slot, that slot will solve them
+  std::vector<size_t> alone;
+  for (size_t i = 0; i < slots_; ++i)
+    if ((count[i] >> 2) == 1)
+      alone.push_back(i);
+  std::vector<uint64_t> peeled;
+  std::vector<uint8_t> peeled_slot;
+  peeled.reserve(xs.size());
+  peeled_slot.reserve(xs.size());
+  while (! alone.empty())
+  {
+    auto i = alone.back();
+    alone.pop_back();
+    if ((count[i] >> 2) != 1)
+      continue;
+    auto x = xored[i];
+    peeled.push_back(x);
+    peeled_slot.push_back(count[i] & 3);
+    positions(x, segment_length_, segment_count_length, h);
+    for (uint32_t j = 0; j < 3; ++j)
+    {
+      count[h[j]] = (count[h[j]] ^ j) - 4;
+      xored[h[j]] ^= x;
+      if ((count[h[j]] >> 2) == 1)
+        alone.push_back(h[j]);
+    }
+  }
+  if (peeled.size() != xs.size())
+    return false;
+
+  // in reverse peeling order each digest sets its slot, the other two are final
+  words_.assign(words(slots_, bits_), 0);
+  auto bytes = reinterpret_cast<char*>(words_.data());
+  for (auto p = peeled.size(); p-- > 0; )
+  {
+    auto x = peeled[p];
+    auto j = peeled_slot[p];
+    positions(x, segment_length_, segment_count_length, h);
+    auto value = fingerprint(x, bits_)
+      ^ slot(words_.data(), h[(j + 1) % 3], bits_)
+      ^ slot(words_.data(), h[(j + 2) % 3], bits_);
+    auto bit = h[j] * bits_;
+    uint64_t w;
+    std::memcpy(&w, bytes + bit / 8, sizeof(w));
+    w |= value << (bit % 8);
+    std::memcpy(bytes + bit / 8, &w, sizeof(w));
+  }
+  return true;
+}
+
+} // namespace bf
@@ -0,0 +1,204 @@
+#ifndef BF_BLOOM_FILTER_FUSE_H
+#define BF_BLOOM_FILTER_FUSE_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "bloom_filter.h"
+#include "hash.h"
+
+namespace bf {
+
+/// A 3-wise binary fuse filter (Graf and Lemire). Every object is mapped to
+/// three slots in consecutive segments, and the slots hold *bits*-bit values
+/// whose XOR is the fingerprint of each added object. Another object matches
+/// with probability 2^-bits, at about 1.13 * bits bits per object and three
+/// probes per lookup, where a Bloom filter of the same false-positive rate
+/// takes 1.44 * bits bits.
+///
+/// The filter is static: objects are collected by add() and the slots are
+/// solved by build(), which must run before lookup(). Adding to a built
+/// filter builds it again. The digests of the added objects are kept for
+/// that, they are not part of size().
+///
+/// A key is hashed once and the digest remixed with the salt, see
+/// ::remix. When the slots cannot be solved, build() moves on
+/// to the next salt of the same level, salt + 2^24, and salt() tells which
+/// one it used.
+class binary_fuse_filter : public bloom_filter
+{
+public:
+  /// The largest number of fingerprint bits.
+  static size_t const max_bits = 32;
+
+  /// The salt step build() takes when the slots cannot be solved.
+  static size_t const salt_step = size_t(1) << 24;
+
+  /// Computes the number of fingerprint bits for a false-positive rate.
+  /// @param fp The desired false-positive rate.
+  /// @return The bits, in `[1, max_bits]`, that guarantee *fp*.
+  static size_t fingerprint_bits(double fp);
+
+  /// Computes the segment length for a number of objects.
+  /// @param capacity The number of objects.
+  /// @return A power of two.
+  static size_t segment_length_for(size_t capacity);
+
+  /// Computes the number of slots for a number of objects.
+  /// @param capacity The number of objects.
+  /// @return The slots of a filter with room for *capacity* objects.
+  static size_t slots(size_t capacity);
+
+  /// Computes the number of words that hold the slots, with one word of
+  /// padding for the unaligned loads of slot().
+  static size_t words(size_t slots, size_t bits)
+  {
+    return (slots * bits + 63) / 64 + 1;
+  }
+
+  /// Computes the three slots of a remixed digest.
+  /// @param x The remixed digest of an object.
+  /// @param segment_length The segment length.
+  /// @param segment_count_length The slots minus two segments.
+  /// @param h The three slots.
+  static void positions(uint64_t x, size_t segment_length,
+                        size_t segment_count_length, size_t* h)
+  {
+    h[0] = static_cast<size_t>(
+      (static_cast<unsigned __int128>(x) * segment_count_length) >> 64);
+    h[1] = h[0] + segment_length;
+    h[2] = h[1] + segment_length;
+    h[1] ^= (x >> 18) & (segment_length - 1);
+    h[2] ^= x & (segment_length - 1);
+  }
+
+  /// Computes the fingerprint of a remixed digest.
+  static uint64_t fingerprint(uint64_t x, size_t bits)
+  {
+    return (x ^ (x >> 32)) & ((uint64_t(1) << bits) - 1);
+  }
+
+  /// Reads a slot.
+  /// @param words The slots, padded as by words().
+  /// @param i The index of the slot.
+  /// @param bits The bits of a slot.
+  static uint64_t slot(uint64_t const* words, size_t i, size_t bits)
+  {
+    auto bit = i * bits;
+    uint64_t w;
+    std::memcpy(&w, reinterpret_cast<char const*>(words) + bit / 8, sizeof(w));
+    return (w >> (bit % 8)) & ((uint64_t(1) << bits) - 1);
+  }
+
+  /// Tests a remixed digest against the slots.
+  static bool test(uint64_t const* words, size_t bits, size_t segment_length,
+                   size_t segment_count_length, uint64_t x)
+  {
+    size_t h[3];
+    positions(x, segment_length, segment_count_length, h);
+    return (slot(words, h[0], bits) ^ slot(words, h[1], bits)
+            ^ slot(words, h[2], bits)) == fingerprint(x, bits);
+  }
+
+  /// Constructs an empty binary fuse filter.
+  ///
+  /// @param fp The desired false-positive probability.
+  ///
+  /// @param capacity The expected number of objects, reserved up front.
+  ///
+  /// @param seed The seed of the hash function. The function is the first
+  /// one ::make_hasher would create with this seed.
+  ///
+  /// @param salt The first salt the digest is remixed with.
+  ///
+  /// @param family The family of the hash function.
+  binary_fuse_filter(double fp, size_t capacity = 0, size_t seed = 0,
+                     size_t salt = 0, hash_family family = hash_family::h3);
+
+  binary_fuse_filter(binary_fuse_filter&&);
+
+  using bloom_filter::add;
+  using bloom_filter::lookup;
+
+  virtual void add(object const& o) override;
+
+  /// @pre build() ran after the last add().
+  virtual size_t lookup(object const& o) const override;
+  virtual void clear() override;
+
+  /// Solves the slots for the added objects.
+  void build();
+
+  /// Checks whether the slots match the added objects.
+  bool built() const
+  {
+    return built_;
+  }
+
+  /// Retrieves the size of the slots in bytes.
+  size_t size() const
+  {
+    return words_.size() * sizeof(uint64_t);
+  }
+
+  /// Retrieves the number of fingerprint bits.
+  size_t bits() const
+  {
+    return bits_;
+  }
+
+  /// Retrieves the number of slots.
+  size_t num_slots() const
+  {
+    return slots_;
+  }
+
+  /// Retrieves the segment length.
+  size_t segment_length() const
+  {
+    return segment_length_;
+  }
+
+  /// Retrieves the seed of the hash function.
+  size_t seed() const
+  {
+    return seed_;
+  }
+
+  /// Retrieves the salt the digests are remixed with.
+  size_t salt() const
+  {
+    return salt_;
+  }
+
+  /// Retrieves the family of the hash function.
+  hash_family family() const
+  {
+    return hash_.family();
+  }
+
+  /// Retrieves the slots, padded as by words().
+  uint64_t const* data() const
+  {
+    return words_.data();
+  }
+
+private:
+  // solves the slots with the current salt, false if the digests do not peel
+  bool solve(std::vector<uint64_t> const& xs);
+
+  size_t bits_;
+  size_t capacity_;
+  size_t seed_;
+  size_t salt_;
+  size_t slots_ = 0;
+  size_t segment_length_ = 0;
+  bool built_ = false;
+  family_hash_function hash_;
+  std::vector<digest> digests_;  ///< of the added objects, before remixing
+  std::vector<uint64_t> words_;
+};
+
+} // namespace bf
+
+#endif
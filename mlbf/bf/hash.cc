@@ -1,7 +1,10 @@
-#include <iostream>
 #include "hash.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <map>
+#include <mutex>
 
 namespace bf {
 
@@ -10,15 +13,135 @@ default_hash_function::default_hash_function(size_t seed)
 {
 }
 
-size_t default_hash_function::operator()(object const& o) const
+size_t default_hash_function::operator()(void const* data, size_t size) const
 {
-  // FIXME: fall back to a generic universal hash function (e.g., HMAC/MD5) for
-  // too large objects.
-  if (o.size() > max_obj_size) {
-    std::cout << "key size " << o.size() << std::endl;
-    throw std::runtime_error("object too large");
+  if (size <= max_obj_size)
+    return size == 0 ? 0 : h3_(data, size);
+  auto p = static_cast<unsigned char const*>(data);
+  size_t const chunk = max_obj_size;
+  digest d = 0;
+  for (size_t i = 0; i < size; i += chunk)
+    d = remix(d ^ h3_(p + i, std::min(chunk, size - i)), i / chunk);
+  return d;
+}
+
+namespace {
+
+// The reflected CRC32-C polynomial.
+uint32_t const crc32c_poly = 0x82f63b78;
+
+// The odd constant the words of the second lane are multiplied with.
+uint64_t const crc32c_lane = 0x9e3779b97f4a7c15ULL;
+
+struct crc32c_table
+{
+  crc32c_table()
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      auto c = i;
+      for (int bit = 0; bit < 8; ++bit)
+        c = c & 1 ? (c >> 1) ^ crc32c_poly : c >> 1;
+      t[i] = c;
+    }
+  }
+
+  uint32_t t[256];
+};
+
+uint64_t load_word(unsigned char const* p, size_t n)
+{
+  uint64_t x = 0;
+  std::memcpy(&x, p, n);
+  return x;
+}
+
+uint32_t crc32c_word(crc32c_table const& table, uint32_t crc, uint64_t w)
+{
+  for (int i = 0; i < 8; ++i, w >>= 8)
+    crc = table.t[(crc ^ w) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+digest crc32c_software(void const* data, size_t size, size_t seed)
+{
+  static crc32c_table const table;
+  auto p = static_cast<unsigned char const*>(data);
+  uint32_t a = static_cast<uint32_t>(seed);
+  uint32_t b = static_cast<uint32_t>(seed >> 32) ^ ~a;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    auto w = load_word(p + i, 8);
+    a = crc32c_word(table, a, w);
+    b = crc32c_word(table, b, w * crc32c_lane);
+  }
+  if (i < size)
+  {
+    auto w = load_word(p + i, size - i);
+    a = crc32c_word(table, a, w);
+    b = crc32c_word(table, b, w * crc32c_lane);
+  }
+  return remix(uint64_t(b) << 32 | a, size);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+digest crc32c_hardware(void const* data, size_t size, size_t seed)
+{
+  auto p = static_cast<unsigned char const*>(data);
+  uint64_t a = static_cast<uint32_t>(seed);
+  uint64_t b = static_cast<uint32_t>(seed >> 32) ^ static_cast<uint32_t>(~a);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    auto w = load_word(p + i, 8);
+    a = __builtin_ia32_crc32di(a, w);
+    b = __builtin_ia32_crc32di(b, w * crc32c_lane);
+  }
+  if (i < size)
+  {
+    auto w = load_word(p + i, size - i);
+    a = __builtin_ia32_crc32di(a, w);
+    b = __builtin_ia32_crc32di(b, w * crc32c_lane);
+  }
+  return remix(b << 32 | a, size);
+}
+#endif
+
+std::shared_ptr<default_hash_function const> shared_h3(size_t seed)
+{
+  // the tables live as long as a function of their seed does
+  static std::mutex mutex;
+  static std::map<size_t, std::weak_ptr<default_hash_function const>> tables;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto h = tables[seed].lock();
+  if (! h)
+  {
+    h = std::make_shared<default_hash_function const>(seed);
+    tables[seed] = h;
   }
-  return o.size() == 0 ? 0 : h3_(o.data(), o.size());
+  return h;
+}
+
+} // namespace <anonymous>
+
+digest crc32c_hash(void const* data, size_t size, size_t seed)
+{
+#if defined(__x86_64__)
+  static bool const hardware = __builtin_cpu_supports("sse4.2");
+  if (hardware)
+    return crc32c_hardware(data, size, seed);
+#endif
+  return crc32c_software(data, size, seed);
+}
+
+family_hash_function::family_hash_function(hash_family family, size_t seed)
+  : family_(family),
+    seed_(seed)
+{
+  if (family_ == hash_family::h3)
+    h3_ = shared_h3(seed);
 }
 
 default_hasher::default_hasher(std::vector<hash_function> fns)
@@ -52,23 +175,37 @@ std::vector<digest> double_hasher::operator()(object const& o) const
   return d;
 }
 
-hasher make_hasher(size_t k, size_t seed, bool double_hashing)
+hasher make_hasher(size_t k, size_t seed, bool double_hashing,
+                   hash_family family)
 {
   assert(k > 0);
   std::minstd_rand0 prng(seed);
   if (double_hashing)
   {
-    auto h1 = default_hash_function(prng());
-    auto h2 = default_hash_function(prng());
+    auto h1 = family_hash_function(family, prng());
+    auto h2 = family_hash_function(family, prng());
     return double_hasher(k, std::move(h1), std::move(h2));
   }
   else
   {
     std::vector<hash_function> fns(k);
     for (size_t i = 0; i < k; ++i)
-      fns[i] = default_hash_function(prng());
+      fns[i] = family_hash_function(family, prng());
     return default_hasher(std::move(fns));
   }
 }
 
+std::unique_ptr<default_static_hasher> make_static_hasher(size_t k,
+                                                          size_t seed,
+                                                          size_t salt,
+                                                          hash_family family)
+{
+  assert(k > 0 && k <= default_static_hasher::max_k);
+  std::minstd_rand0 prng(seed);
+  auto h1 = family_hash_function(family, prng());
+  auto h2 = family_hash_function(family, prng());
+  return std::unique_ptr<default_static_hasher>(
+    new default_static_hasher(k, std::move(h1), std::move(h2), salt));
+}
+
 } // namespace bf
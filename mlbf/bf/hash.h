@@ -1,7 +1,11 @@
 #ifndef BF_HASH_POLICY_H
 #define BF_HASH_POLICY_H
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <vector>
 #include "h3.h"
 #include "object.h"
 
@@ -16,6 +20,9 @@ typedef std::function<digest(object const&)> hash_function;
 /// A function that hashes an object *k* times.
 typedef std::function<std::vector<digest>(object const&)> hasher;
 
+/// The H3 hash function. Its tables cover ::max_obj_size bytes; longer
+/// objects are hashed in chunks of that size and the chunk digests chained
+/// with ::remix, so objects up to ::max_obj_size bytes keep their digests.
 class default_hash_function
 {
 public:
@@ -23,12 +30,120 @@ public:
 
   default_hash_function(size_t seed);
 
-  size_t operator()(object const& o) const;
+  size_t operator()(object const& o) const
+  {
+    return (*this)(o.data(), o.size());
+  }
+
+  size_t operator()(void const* data, size_t size) const;
 
 private:
   h3<size_t, max_obj_size> h3_;
 };
 
+/// The families of hash functions a filter can hash objects with.
+enum class hash_family : uint32_t
+{
+  h3,       ///< ::default_hash_function, 128 KB of tables per function.
+  crc32c,   ///< Two CRC32-C lanes, see crc32c_hash().
+  mix64     ///< A multiply-mix, see mix64_hash().
+};
+
+/// Hashes bytes with CRC32-C, using the SSE 4.2 instruction when the CPU
+/// has it and a table otherwise. One lane runs over the 8-byte words of the
+/// object, a second one over the words multiplied by an odd constant, so the
+/// 64-bit digest does not depend linearly on the object as CRC does.
+/// @param data The bytes to hash.
+/// @param size The number of bytes.
+/// @param seed The seed.
+/// @return The digest.
+digest crc32c_hash(void const* data, size_t size, size_t seed);
+
+/// Hashes bytes with a multiply-mix in the style of wyhash: every 16 bytes
+/// are folded into the state by one 64x64->128-bit multiplication.
+/// @param data The bytes to hash.
+/// @param size The number of bytes.
+/// @param seed The seed.
+/// @return The digest.
+inline digest mix64_hash(void const* data, size_t size, size_t seed)
+{
+  auto load = [](unsigned char const* p, size_t n) -> uint64_t
+  {
+    uint64_t x = 0;
+    std::memcpy(&x, p, n);
+    return x;
+  };
+  auto mum = [](uint64_t a, uint64_t b) -> uint64_t
+  {
+    auto r = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+  };
+  uint64_t const k0 = 0xa0761d6478bd642fULL;
+  uint64_t const k1 = 0xe7037ed1a0b428dbULL;
+  uint64_t const k2 = 0x8ebc6af09c88c6e3ULL;
+  auto p = static_cast<unsigned char const*>(data);
+  uint64_t h = mum(seed ^ k0, k1);
+  auto n = size;
+  for (; n > 16; n -= 16, p += 16)
+    h = mum(load(p, 8) ^ k1, load(p + 8, 8) ^ h);
+  uint64_t a = 0, b = 0;
+  if (n >= 8)
+  {
+    a = load(p, 8);
+    b = load(p + n - 8, 8);
+  }
+  else if (n >= 4)
+  {
+    a = load(p, 4);
+    b = load(p + n - 4, 4);
+  }
+  else if (n > 0)
+  {
+    a = uint64_t(p[0]) << 16 | uint64_t(p[n / 2]) << 8 | p[n - 1];
+  }
+  return mum(k2 ^ size, mum(a ^ k1, b ^ h));
+}
+
+/// A hash function of a ::hash_family. Functions of the H3 family with the
+/// same seed share one set of tables, so filters built with one seed keep
+/// a single copy of them.
+class family_hash_function
+{
+public:
+  /// Constructs a hash function.
+  /// @param family The hash family.
+  /// @param seed The seed of the function.
+  family_hash_function(hash_family family, size_t seed);
+
+  digest operator()(object const& o) const
+  {
+    return (*this)(o.data(), o.size());
+  }
+
+  digest operator()(void const* data, size_t size) const
+  {
+    switch (family_)
+    {
+      case hash_family::crc32c:
+        return crc32c_hash(data, size, seed_);
+      case hash_family::mix64:
+        return mix64_hash(data, size, seed_);
+      default:
+        return (*h3_)(data, size);
+    }
+  }
+
+  hash_family family() const
+  {
+    return family_;
+  }
+
+private:
+  hash_family family_;
+  size_t seed_;
+  std::shared_ptr<default_hash_function const> h3_;
+};
+
 /// A hasher which hashes an object *k* times.
 class default_hasher
 {
@@ -56,7 +171,106 @@ private:
   hash_function h2_;
 };
 
-/// Creates a default or double hasher with the default hash function, using
+/// Remixes a digest with a salt, a bijection of the digest for every salt.
+/// Digests of one hash function remixed with different salts behave like
+/// digests of independent hash functions: filters that share the seed but
+/// not the salt place objects independently, so a cascade of filters can
+/// hash each object only once. Objects with equal digests stay equal under
+/// every salt, only another seed tells them apart.
+/// @param d The digest.
+/// @param salt The salt.
+/// @return The remixed digest.
+inline digest remix(digest d, size_t salt)
+{
+  uint64_t x = d + (salt + 1) * 0x9e3779b97f4a7c15ULL;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/// A double hasher with the hash function type and the maximum number of
+/// digests fixed at compile time. Unlike ::double_hasher it makes no
+/// type-erased calls and writes the digests into a caller-provided buffer,
+/// so hashing does not allocate. The second hash is only computed for `k > 1`.
+/// A non-zero salt remixes both hashes with ::remix before they are combined.
+///
+/// @tparam HashFunction A hash function with `digest operator()(object const&)`.
+///
+/// @tparam MaxK The capacity of the digest buffer.
+template <typename HashFunction, size_t MaxK>
+class static_double_hasher
+{
+public:
+  static size_t const max_k = MaxK;
+
+  /// @pre `0 < k <= MaxK`
+  static_double_hasher(size_t k, HashFunction h1, HashFunction h2,
+                       size_t salt = 0)
+    : k_(k),
+      salt_(salt),
+      h1_(std::move(h1)),
+      h2_(std::move(h2))
+  {
+  }
+
+  size_t k() const
+  {
+    return k_;
+  }
+
+  size_t salt() const
+  {
+    return salt_;
+  }
+
+  /// Hashes an object *k* times.
+  /// @param o The object to hash.
+  /// @param d A buffer of at least *k* digests.
+  /// @return The number of digests written, i.e. *k*.
+  size_t operator()(object const& o, digest* d) const
+  {
+    auto d1 = h1_(o);
+    auto d2 = k_ > 1 ? h2_(o) : 0;
+    if (salt_ != 0)
+    {
+      d1 = remix(d1, salt_);
+      d2 = k_ > 1 ? remix(d2, salt_) : 0;
+    }
+    for (size_t i = 0; i < k_; ++i)
+      d[i] = d1 + i * d2;
+    return k_;
+  }
+
+  /// Hashes an object *k* times, for use as a ::hasher.
+  std::vector<digest> operator()(object const& o) const
+  {
+    std::vector<digest> d(k_);
+    (*this)(o, d.data());
+    return d;
+  }
+
+private:
+  size_t k_;
+  size_t salt_;
+  HashFunction h1_;
+  HashFunction h2_;
+};
+
+/// The statically dispatched double hasher used by ::basic_bloom_filter.
+typedef static_double_hasher<family_hash_function, 16> default_static_hasher;
+
+/// Creates a ::default_static_hasher with the same hash functions as
+/// `make_hasher(k, seed, true, family)`, remixed with *salt* if it is not 0.
+///
+/// @pre `0 < k <= default_static_hasher::max_k`
+std::unique_ptr<default_static_hasher> make_static_hasher(
+  size_t k, size_t seed = 0, size_t salt = 0,
+  hash_family family = hash_family::h3);
+
+/// Creates a default or double hasher with hash functions of a family, using
 /// seeds from a linear congruential PRNG.
 ///
 /// @param k The number of hash functions to use.
@@ -66,10 +280,13 @@ private:
 /// @param double_hashing If `true`, the function constructs a ::double_hasher
 /// and a ::default_hasher otherwise.
 ///
+/// @param family The family of the hash functions.
+///
 /// @return A ::hasher with the *k* hash functions.
 ///
 /// @pre `k > 0`
-hasher make_hasher(size_t k, size_t seed = 0, bool double_hashing = false);
+hasher make_hasher(size_t k, size_t seed = 0, bool double_hashing = false,
+                   hash_family family = hash_family::h3);
 
 } // namespace bf
 
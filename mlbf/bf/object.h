@@ -1,6 +1,7 @@
 #ifndef BF_OBJECT_H
 #define BF_OBJECT_H
 
+#include <cstddef>
 #include <type_traits>
 
 namespace bf {
@@ -2,6 +2,7 @@
 #define BF_WRAP_H
 
 #include <type_traits>
+#include <string>
 #include <vector>
 #include "object.h"
 
@@ -0,0 +1,241 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <sys/mman.h>
+#include "frozen_mlbf.hpp"
+
+using namespace std;
+
+// A delta is a header, the level table of the new filter and the XOR of the old and the new
+// bits, both padded with zero words to the longer one. The XOR is a sequence of runs: a varint
+// count of zero words, a varint of the count of changed words shifted left by one, then the
+// changed words. The low bit picks their form: 0 stores the words, 1 stores a varint count of
+// set bits and the varint gaps between them, which is smaller when few bits of a word flip.
+namespace {
+
+const uint64_t DELTA_MAGIC = 0x31544c4446424c4dULL;  // "MLBFDLT1" on a little-endian host
+
+struct DeltaHeader {
+    uint64_t magic;
+    uint64_t fromChecksum;
+    uint64_t toChecksum;
+    uint64_t words;         // words of the new filter
+    uint32_t numLevels;     // levels of the new filter
+    uint32_t tableSize;     // bytes of the level table
+};
+
+void putVarint(vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t) v);
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+vector<uint8_t> FrozenMLBFilter::delta(const FrozenMLBFilter& from, const FrozenMLBFilter& to) {
+    vector<char> table = to.fileTable();
+    DeltaHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DELTA_MAGIC;
+    header.fromChecksum = from.contentChecksum();
+    header.toChecksum = to.contentChecksum();
+    header.words = to.words;
+    header.numLevels = to.levels.size();
+    header.tableSize = table.size();
+
+    vector<uint8_t> out(sizeof(header) + table.size());
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), table.data(), table.size());
+
+    size_t n = max(from.words, to.words);
+    auto diff = [&](size_t i) {
+        return (i < from.words ? from.bits[i] : 0) ^ (i < to.words ? to.bits[i] : 0);
+    };
+    for (size_t i = 0; i < n; ) {
+        size_t zeros = 0;
+        while (i + zeros < n && diff(i + zeros) == 0) {
+            zeros++;
+        }
+        // a single zero word between literals is cheaper to keep in the literal run
+        size_t literals = 0;
+        size_t j = i + zeros;
+        while (j + literals < n && (diff(j + literals) != 0
+               || (j + literals + 1 < n && diff(j + literals + 1) != 0))) {
+            literals++;
+        }
+        vector<uint8_t> sparse;
+        uint64_t set = 0, last = 0;
+        for (size_t w = j; w < j + literals; w++) {
+            set += __builtin_popcountll(diff(w));
+        }
+        putVarint(sparse, set);
+        for (size_t w = j; w < j + literals && sparse.size() <= literals * sizeof(uint64_t); w++) {
+            for (uint64_t x = diff(w); x != 0; x &= x - 1) {
+                uint64_t pos = (w - j) * 64 + __builtin_ctzll(x);
+                putVarint(sparse, pos - last);
+                last = pos + 1;
+            }
+        }
+
+        putVarint(out, zeros);
+        if (sparse.size() < literals * sizeof(uint64_t)) {
+            putVarint(out, literals << 1 | 1);
+            out.insert(out.end(), sparse.begin(), sparse.end());
+        } else {
+            putVarint(out, literals << 1);
+            for (size_t w = j; w < j + literals; w++) {
+                uint64_t x = diff(w);
+                size_t at = out.size();
+                out.resize(at + sizeof(x));
+                memcpy(&out[at], &x, sizeof(x));
+            }
+        }
+        i = j + literals;
+    }
+    return out;
+}
+
+void FrozenMLBFilter::applyDelta(const vector<uint8_t>& delta) {
+    if (delta.size() < sizeof(DeltaHeader)) {
+        throw invalid_argument("truncated MLBF delta");
+    }
+    DeltaHeader header;
+    memcpy(&header, delta.data(), sizeof(header));
+    if (header.magic != DELTA_MAGIC || header.tableSize % 64 != 0
+        || (uint64_t) header.numLevels * sizeof(FileLevel) > header.tableSize
+        || header.tableSize > delta.size() - sizeof(header) || header.words > SIZE_MAX / sizeof(uint64_t)) {
+        throw invalid_argument("malformed MLBF delta");
+    }
+    if (header.fromChecksum != contentChecksum()) {
+        throw invalid_argument("MLBF delta was made from another filter");
+    }
+
+    // the new level table must lay out exactly header.words words before anything is sized by it
+    vector<Level> oldLevels;
+    vector<Group> oldGroups;
+    oldLevels.swap(levels);
+    oldGroups.swap(groups);
+    auto restoreLevels = [&]() {
+        levels.swap(oldLevels);
+        groups.swap(oldGroups);
+    };
+    vector<FileLevel> table(header.numLevels);
+    memcpy(table.data(), delta.data() + sizeof(header), table.size() * sizeof(FileLevel));
+    if (!setLevels(table.data(), header.numLevels, header.words)) {
+        restoreLevels();
+        throw invalid_argument("malformed MLBF delta");
+    }
+
+    // check the runs before touching the bits
+    size_t n = max<uint64_t>(words, header.words);
+    const uint8_t* runs = delta.data() + sizeof(header) + header.tableSize;
+    const uint8_t* end = delta.data() + delta.size();
+    // walks the runs, calling flip(word, mask) for every changed word; false if malformed
+    auto walk = [&](function<void(size_t, uint64_t)> flip) {
+        const uint8_t* q = runs;
+        for (size_t i = 0; q < end; ) {
+            uint64_t zeros, run;
+            if (!getVarint(q, end, zeros) || !getVarint(q, end, run)) {
+                return false;
+            }
+            uint64_t literals = run >> 1;
+            if (zeros > n - i || literals > n - i - zeros) {
+                return false;
+            }
+            i += zeros;
+            if (run & 1) {
+                uint64_t set, pos = 0, gap;
+                if (!getVarint(q, end, set)) {
+                    return false;
+                }
+                for (uint64_t b = 0; b < set; b++, pos++) {
+                    if (!getVarint(q, end, gap) || gap >= literals * 64 - pos) {
+                        return false;
+                    }
+                    pos += gap;
+                    flip(i + pos / 64, 1ULL << (pos % 64));
+                }
+            } else {
+                if (literals > (uint64_t) (end - q) / sizeof(uint64_t)) {
+                    return false;
+                }
+                for (uint64_t w = 0; w < literals; w++, q += sizeof(uint64_t)) {
+                    uint64_t x;
+                    memcpy(&x, q, sizeof(x));
+                    flip(i + w, x);
+                }
+            }
+            i += literals;
+        }
+        return true;
+    };
+    if (!walk([](size_t, uint64_t) {})) {
+        restoreLevels();
+        throw invalid_argument("malformed MLBF delta");
+    }
+    auto xorRuns = [&](uint64_t* target) {
+        walk([target](size_t w, uint64_t mask) { target[w] ^= mask; });
+    };
+
+    // patch in place when the size is unchanged, a failed check undoes the XOR
+    uint64_t* oldBits = bits;
+    size_t oldWords = words;
+    bool inPlace = !mapping && header.words == words;
+    uint64_t* next = bits;
+    if (!inPlace) {
+        if (posix_memalign((void**) &next, 64, max<size_t>(n, 1) * sizeof(uint64_t)) != 0) {
+            restoreLevels();
+            throw bad_alloc();
+        }
+        memset(next, 0, max<size_t>(n, 1) * sizeof(uint64_t));
+        memcpy(next, bits, words * sizeof(uint64_t));
+    }
+    xorRuns(next);
+    // the words past the end of the new filter must be cleared by the delta
+    bool valid = true;
+    for (size_t w = header.words; w < n; w++) {
+        valid = valid && next[w] == 0;
+    }
+    bits = next;
+    words = header.words;
+    if (valid) {
+        makeHashers();
+        valid = contentChecksum() == header.toChecksum;
+    }
+    if (!valid) {
+        if (inPlace) {
+            xorRuns(next);
+        } else {
+            free(next);
+        }
+        bits = oldBits;
+        words = oldWords;
+        restoreLevels();
+        throw invalid_argument("MLBF delta does not produce its filter");
+    }
+
+    if (mapping) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        mappingSize = 0;
+    } else if (!inPlace) {
+        free(oldBits);
+    }
+}
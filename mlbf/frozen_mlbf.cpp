@@ -0,0 +1,471 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "frozen_mlbf.hpp"
+
+using bf::basic_bloom_filter;
+using namespace std;
+
+const size_t FrozenMLBFilter::MAX_INFLIGHT;
+
+FrozenMLBFilter::FrozenMLBFilter(const MLBFilter& mlbf) {
+    for (size_t i = 0; i < mlbf.numLevels(); i++) {
+        Level level;
+        level.segmentLength = 0;
+        level.offset = words;
+        level.kind = mlbf.levelKind(i);
+        size_t seed, levelWords;
+        bf::hash_family family;
+        if (level.kind == BLOCKED_BLOOM) {
+            const blocked_bloom_filter& filter = static_cast<const blocked_bloom_filter&>(mlbf.level(i));
+            level.size = filter.blocks();
+            level.M = 0;
+            level.k = 1;  // only d1 is used, the mask carries the probes
+            level.salt = filter.salt();
+            seed = filter.seed();
+            family = filter.family();
+            levelWords = filter.blocks() * blocked_bloom_filter::block_words;
+        } else if (level.kind == EXACT_SET) {
+            const fingerprint_set& filter = static_cast<const fingerprint_set&>(mlbf.level(i));
+            level.size = filter.count();
+            level.M = 0;
+            level.k = 1;
+            level.salt = filter.salt();
+            seed = filter.seed();
+            family = filter.family();
+            levelWords = filter.count();
+        } else if (level.kind == BINARY_FUSE) {
+            const binary_fuse_filter& filter = static_cast<const binary_fuse_filter&>(mlbf.level(i));
+            level.size = filter.num_slots();
+            level.M = 0;
+            level.k = 1;  // only d1 is used
+            level.salt = filter.salt();
+            level.segmentLength = filter.segment_length();
+            seed = filter.seed();
+            family = filter.family();
+            levelWords = filter.size() / sizeof(uint64_t);
+        } else {
+            const basic_bloom_filter& filter = static_cast<const basic_bloom_filter&>(mlbf.level(i));
+            if (filter.num_hashes() == 0 || !filter.double_hashing()) {
+                throw invalid_argument("FrozenMLBFilter needs levels built with double hashing");
+            }
+            level.size = filter.storage().size();
+            level.M = ~(unsigned __int128) 0 / level.size + 1;
+            level.k = filter.num_hashes();
+            level.salt = filter.salt();
+            seed = filter.seed();
+            family = filter.family();
+            levelWords = filter.storage().blocks();
+        }
+
+        level.group = groupOf(seed, family, level.k);
+        if (level.kind == BLOCKED_BLOOM) {
+            level.k = static_cast<const blocked_bloom_filter&>(mlbf.level(i)).num_hashes();
+        } else if (level.kind == BINARY_FUSE) {
+            level.k = static_cast<const binary_fuse_filter&>(mlbf.level(i)).bits();
+        }
+
+        // round every level up to a cache line
+        words += (levelWords + 7) / 8 * 8;
+        levels.push_back(level);
+    }
+
+    makeHashers();
+
+    if (posix_memalign((void**) &bits, 64, max<size_t>(words, 1) * sizeof(uint64_t)) != 0) {
+        throw bad_alloc();
+    }
+    memset(bits, 0, max<size_t>(words, 1) * sizeof(uint64_t));
+    static_assert(sizeof(bf::bitvector::block_type) == sizeof(uint64_t), "64-bit blocks expected");
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (levels[i].kind == BLOCKED_BLOOM) {
+            const blocked_bloom_filter& filter = static_cast<const blocked_bloom_filter&>(mlbf.level(i));
+            memcpy(bits + levels[i].offset, filter.data(), filter.blocks() * blocked_bloom_filter::block_words * sizeof(uint64_t));
+        } else if (levels[i].kind == EXACT_SET) {
+            const fingerprint_set& filter = static_cast<const fingerprint_set&>(mlbf.level(i));
+            memcpy(bits + levels[i].offset, filter.data(), filter.size());
+        } else if (levels[i].kind == BINARY_FUSE) {
+            const binary_fuse_filter& filter = static_cast<const binary_fuse_filter&>(mlbf.level(i));
+            memcpy(bits + levels[i].offset, filter.data(), filter.size());
+        } else {
+            const bf::bitvector& storage = static_cast<const basic_bloom_filter&>(mlbf.level(i)).storage();
+            memcpy(bits + levels[i].offset, storage.data(), storage.blocks() * sizeof(uint64_t));
+        }
+    }
+}
+
+FrozenMLBFilter::FrozenMLBFilter(const string& path, bool verify) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(FileHeader)) {
+        close(fd);
+        throw runtime_error(path + " is not a frozen MLBF");
+    }
+    mappingSize = st.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw runtime_error("cannot map " + path);
+    }
+
+    const char* base = (const char*) mapping;
+    const FileHeader& header = *(const FileHeader*) base;
+    // the level table lies between the header and the bits, compared without sums that can wrap
+    bool valid = header.magic == MAGIC && header.version == VERSION
+                 && header.levelsOffset % 64 == 0 && header.bitsOffset % 64 == 0
+                 && header.levelsOffset >= sizeof(FileHeader) && header.levelsOffset <= header.bitsOffset
+                 && header.numLevels <= (header.bitsOffset - header.levelsOffset) / sizeof(FileLevel)
+                 && header.bitsOffset <= mappingSize
+                 && header.words <= (mappingSize - header.bitsOffset) / sizeof(uint64_t);
+    if (valid && verify) {
+        uint64_t h = checksum(base + header.levelsOffset, header.bitsOffset - header.levelsOffset, 0);
+        valid = checksum(base + header.bitsOffset, header.words * sizeof(uint64_t), h) == header.checksum;
+    }
+    if (valid) {
+        valid = setLevels((const FileLevel*) (base + header.levelsOffset), header.numLevels, header.words);
+    }
+    if (!valid) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        throw runtime_error(path + " is not a valid frozen MLBF");
+    }
+
+    makeHashers();
+    bits = (uint64_t*) (base + header.bitsOffset);
+    words = header.words;
+}
+
+FrozenMLBFilter::~FrozenMLBFilter() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    } else {
+        free(bits);
+    }
+}
+
+bool FrozenMLBFilter::setLevels(const FileLevel* table, uint32_t numLevels, uint64_t numWords) {
+    levels.clear();
+    groups.clear();
+    uint64_t used = 0;
+    for (uint32_t i = 0; i < numLevels; i++) {
+        const FileLevel& fl = table[i];
+        Level level;
+        level.segmentLength = 0;
+        level.offset = fl.offset;
+        level.size = fl.size;
+        level.k = fl.k;
+        level.salt = fl.salt;
+        uint64_t levelWords;
+        bool valid;
+        if (fl.kind > (uint32_t) BINARY_FUSE || fl.family > (uint32_t) bf::hash_family::mix64) {
+            return false;
+        }
+        level.kind = (FilterKind) fl.kind;
+        bf::hash_family family = (bf::hash_family) fl.family;
+        if (level.kind == BLOCKED_BLOOM) {
+            level.M = 0;
+            level.group = groupOf(fl.seed, family, 1);
+            levelWords = level.size * blocked_bloom_filter::block_words;
+            valid = level.k <= blocked_bloom_filter::max_k && level.size <= numWords / blocked_bloom_filter::block_words;
+        } else if (level.kind == EXACT_SET) {
+            level.M = 0;
+            level.group = groupOf(fl.seed, family, 1);
+            levelWords = level.size;
+            valid = i + 1 == numLevels;
+        } else if (level.kind == BINARY_FUSE) {
+            level.M = 0;
+            level.k = fl.k & 0xff;
+            uint32_t segmentBits = fl.k >> 8;
+            level.segmentLength = segmentBits < 32 ? 1U << segmentBits : 0;
+            level.group = groupOf(fl.seed, family, 1);
+            valid = level.k >= 1 && level.k <= binary_fuse_filter::max_bits && level.segmentLength > 0
+                    && level.size % level.segmentLength == 0 && level.size / level.segmentLength >= 3 && level.size / 64 <= numWords;
+            levelWords = valid ? binary_fuse_filter::words(level.size, level.k) : 0;
+        } else {
+            level.M = ~(unsigned __int128) 0 / max<uint64_t>(level.size, 1) + 1;
+            level.group = groupOf(fl.seed, family, level.k);
+            levelWords = (level.size + 63) / 64;
+            valid = level.kind == BASIC_BLOOM && level.k > 0;
+        }
+        if (!valid || (level.size == 0 && level.kind != EXACT_SET) || level.offset > numWords || levelWords > numWords - level.offset) {
+            return false;
+        }
+        levels.push_back(level);
+        used = max(used, level.offset + levelWords);
+    }
+    // the levels end in the last group of 8 words, as the filter lays them out
+    return (used + 7) / 8 * 8 == numWords;
+}
+
+vector<char> FrozenMLBFilter::fileTable() const {
+    // padded to a whole cache line, as in the file
+    vector<char> table((levels.size() * sizeof(FileLevel) + 63) / 64 * 64, 0);
+    FileLevel* fileLevels = (FileLevel*) table.data();
+    for (size_t i = 0; i < levels.size(); i++) {
+        fileLevels[i].offset = levels[i].offset;
+        fileLevels[i].size = levels[i].size;
+        fileLevels[i].kind = levels[i].kind;
+        fileLevels[i].k = levels[i].k;
+        if (levels[i].kind == BINARY_FUSE) {
+            fileLevels[i].k |= __builtin_ctz(levels[i].segmentLength) << 8;
+        }
+        fileLevels[i].seed = groups[levels[i].group].seed;
+        fileLevels[i].salt = levels[i].salt;
+        fileLevels[i].family = (uint32_t) groups[levels[i].group].family;
+    }
+    return table;
+}
+
+uint64_t FrozenMLBFilter::contentChecksum() const {
+    vector<char> table = fileTable();
+    return checksum(bits, words * sizeof(uint64_t), checksum(table.data(), table.size(), 0));
+}
+
+uint32_t FrozenMLBFilter::groupOf(size_t seed, bf::hash_family family, uint32_t k) {
+    // levels with the same seed and family share their hash functions
+    uint32_t g = 0;
+    while (g < groups.size() && (groups[g].seed != seed || groups[g].family != family)) {
+        g++;
+    }
+    if (g == groups.size()) {
+        groups.emplace_back();
+        groups.back().seed = seed;
+        groups.back().family = family;
+        groups.back().k = 0;
+    }
+    groups[g].k = max(groups[g].k, k);
+    return g;
+}
+
+void FrozenMLBFilter::makeHashers() {
+    // the same seeds as bf::make_hasher, a blocked filter uses the first one
+    for (Group& group : groups) {
+        minstd_rand0 prng(group.seed);
+        size_t s1 = prng();
+        size_t s2 = prng();
+        group.h1.reset(new bf::family_hash_function(group.family, s1));
+        if (group.k > 1) {
+            group.h2.reset(new bf::family_hash_function(group.family, s2));
+        }
+    }
+}
+
+uint64_t FrozenMLBFilter::checksum(const void* data, size_t size, uint64_t h) {
+    // 64-bit multiply-rotate over words, the sections are whole words
+    const uint64_t* w = (const uint64_t*) data;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+        h = (h ^ w[i]) * 0x9e3779b97f4a7c15ULL;
+        h = (h << 31) | (h >> 33);
+    }
+    return h ^ size;
+}
+
+void FrozenMLBFilter::save(const string& path) const {
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.numLevels = levels.size();
+    header.words = words;
+    header.levelsOffset = (sizeof(FileHeader) + 63) / 64 * 64;
+    header.bitsOffset = (header.levelsOffset + levels.size() * sizeof(FileLevel) + 63) / 64 * 64;
+
+    vector<char> table = fileTable();
+    header.checksum = checksum(bits, words * sizeof(uint64_t), checksum(table.data(), table.size(), 0));
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw runtime_error("cannot create " + path);
+    }
+    vector<char> pad(header.levelsOffset - sizeof(FileHeader), 0);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(pad.data(), 1, pad.size(), file) == pad.size()
+              && fwrite(table.data(), 1, table.size(), file) == table.size()
+              && fwrite(bits, sizeof(uint64_t), words, file) == words;
+    if (fclose(file) != 0 || !ok) {
+        throw runtime_error("cannot write " + path);
+    }
+}
+
+// digests d1, d2 of the hash functions of a group
+void FrozenMLBFilter::hash(const Group& group, void const* data, size_t size, uint64_t& h1, uint64_t& h2) {
+    h1 = (*group.h1)(data, size);
+    h2 = group.h2 ? (*group.h2)(data, size) : 0;
+}
+
+bool FrozenMLBFilter::hit(const Level& level, uint64_t h1, uint64_t h2) const {
+    const uint64_t* base = bits + level.offset;
+    if (level.kind == BLOCKED_BLOOM) {
+        uint64_t x = blocked_bloom_filter::remix(h1, level.salt);
+        uint64_t mask[blocked_bloom_filter::block_words];
+        blocked_bloom_filter::make_mask(x, level.k, mask);
+        return blocked_bloom_filter::test(base + blocked_bloom_filter::block_of(x, level.size) * blocked_bloom_filter::block_words, mask);
+    } else if (level.kind == EXACT_SET) {
+        return fingerprint_set::find(base, level.size, fingerprint_set::fingerprint(h1, level.salt));
+    } else if (level.kind == BINARY_FUSE) {
+        return binary_fuse_filter::test(base, level.k, level.segmentLength, level.size - 2 * level.segmentLength,
+                                        bf::remix(h1, level.salt));
+    }
+    if (level.salt != 0) {
+        h1 = bf::remix(h1, level.salt);
+        h2 = level.k > 1 ? bf::remix(h2, level.salt) : 0;
+    }
+    for (uint32_t i = 0; i < level.k; i++) {
+        if (!test(base, fastmod(h1 + i * h2, level.M, level.size))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrozenMLBFilter::prefetch(const Level& level, uint64_t h1, uint64_t h2) const {
+    const uint64_t* base = bits + level.offset;
+    if (level.kind == BLOCKED_BLOOM) {
+        uint64_t x = blocked_bloom_filter::remix(h1, level.salt);
+        __builtin_prefetch(base + blocked_bloom_filter::block_of(x, level.size) * blocked_bloom_filter::block_words);
+    } else if (level.kind == EXACT_SET) {
+        // the first steps of the binary search
+        __builtin_prefetch(base + level.size / 2);
+        __builtin_prefetch(base + level.size / 4);
+        __builtin_prefetch(base + level.size / 4 * 3);
+    } else if (level.kind == BINARY_FUSE) {
+        size_t h[3];
+        binary_fuse_filter::positions(bf::remix(h1, level.salt), level.segmentLength,
+                                      level.size - 2 * level.segmentLength, h);
+        for (size_t pos : h) {
+            __builtin_prefetch((const char*) base + pos * level.k / 8);
+        }
+    } else {
+        if (level.salt != 0) {
+            h1 = bf::remix(h1, level.salt);
+            h2 = level.k > 1 ? bf::remix(h2, level.salt) : 0;
+        }
+        for (uint32_t i = 0; i < level.k; i++) {
+            __builtin_prefetch(base + (fastmod(h1 + i * h2, level.M, level.size) >> 6));
+        }
+    }
+}
+
+bool FrozenMLBFilter::contains(void const* data, size_t size) const {
+    // d1, d2 of every group, computed on first use
+    uint64_t d1[8], d2[8];
+    uint32_t hashed = 0;
+
+    // contains: false means in S, true means in R
+    bool included = false;
+    for (const Level& level : levels) {
+        uint32_t g = level.group;
+        uint64_t h1, h2;
+        if (g < 8 && (hashed >> g & 1)) {
+            h1 = d1[g];
+            h2 = d2[g];
+        } else {
+            hash(groups[g], data, size, h1, h2);
+            if (g < 8) {
+                d1[g] = h1;
+                d2[g] = h2;
+                hashed |= 1U << g;
+            }
+        }
+        if (!hit(level, h1, h2)) {
+            return included;
+        }
+        included = !included;
+    }
+
+    // passed every level: definitively in R for an odd number of levels
+    return levels.size() % 2 == 1;
+}
+
+void FrozenMLBFilter::containsBatch(bf::object const* keys, size_t n, uint64_t* out, size_t inflight) const {
+    // every key in flight is a state machine at one level. a round tests each of them at the
+    // level whose lines were prefetched a round before, then moves it on to its next level
+    // and prefetches that, or retires it and starts the next key in its place.
+    struct Probe {
+        size_t key;
+        uint32_t level;
+        uint32_t group;     // group of h1, h2
+        bool included;
+        uint64_t h1, h2;
+    };
+    Probe probes[MAX_INFLIGHT];
+    inflight = max<size_t>(1, min(inflight, MAX_INFLIGHT));
+    memset(out, 0, (n + 63) / 64 * sizeof(uint64_t));
+    if (levels.empty()) {
+        return;
+    }
+
+    size_t next = 0;
+    auto advance = [&](Probe& p) {
+        const Level& level = levels[p.level];
+        if (level.group != p.group) {
+            hash(groups[level.group], keys[p.key].data(), keys[p.key].size(), p.h1, p.h2);
+            p.group = level.group;
+        }
+        prefetch(level, p.h1, p.h2);
+    };
+    auto start = [&](Probe& p) {
+        if (next == n) {
+            return false;
+        }
+        p.key = next++;
+        p.level = 0;
+        p.group = UINT32_MAX;
+        p.included = false;
+        advance(p);
+        return true;
+    };
+
+    size_t active = 0;
+    while (active < inflight && start(probes[active])) {
+        active++;
+    }
+    while (active > 0) {
+        for (size_t i = 0; i < active; ) {
+            Probe& p = probes[i];
+            bool done = !hit(levels[p.level], p.h1, p.h2);
+            if (!done) {
+                // passing every level answers R for an odd number of levels, as included does
+                p.included = !p.included;
+                done = ++p.level == levels.size();
+            }
+            if (!done) {
+                advance(p);
+                i++;
+                continue;
+            }
+            if (p.included) {
+                out[p.key / 64] |= 1ULL << (p.key % 64);
+            }
+            if (start(p)) {
+                i++;
+            } else {
+                p = probes[--active];
+            }
+        }
+    }
+}
+
+void FrozenMLBFilter::containsBatch(string const* const* keys, size_t n, uint64_t* out, size_t inflight) const {
+    vector<bf::object> objects;
+    objects.reserve(min<size_t>(n, 1024));
+    for (size_t base = 0; base < n; base += 1024) {
+        size_t cnt = min<size_t>(1024, n - base);
+        objects.clear();
+        for (size_t i = 0; i < cnt; i++) {
+            objects.emplace_back(keys[base + i]->data(), keys[base + i]->size());
+        }
+        containsBatch(objects.data(), cnt, out + base / 64, inflight);
+    }
+}
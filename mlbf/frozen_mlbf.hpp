@@ -0,0 +1,156 @@
+#pragma once
+
+#include "mlbf.hpp"
+#include "bf/hash.h"
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+// Immutable query form of a finished MLBFilter. All levels live in one 64-byte aligned bit
+// array, every level starting on its own cache line. A key is hashed once per distinct level
+// seed and hash family, once in total when all levels share them; levels that differ by salt
+// only remix the digests. The positions of a basic level are d1 + i * d2 reduced by an exact
+// multiply-based modulo, a blocked level tests the mask of d1 against one block, a fuse level
+// XORs three slots of the remixed d1, and an exact level searches the fingerprint of d1. No
+// virtual or std::function call is made, and answers are identical to MLBFilter::contains.
+class FrozenMLBFilter {
+    private:
+        struct Level {
+            uint64_t offset;        // first word of the level in bits
+            uint64_t size;          // number of bits, or of blocks for a blocked level
+            FilterKind kind;
+            unsigned __int128 M;    // fast modulo constant of size
+            uint32_t k;             // number of probes
+            uint32_t group;         // index into groups
+            uint32_t salt;          // salt the digests of the level are remixed with
+            uint32_t segmentLength; // of a BINARY_FUSE level
+        };
+
+        // the hash functions shared by all levels of one seed and family
+        struct Group {
+            size_t seed;
+            bf::hash_family family;
+            uint32_t k;             // largest k of its levels, d2 is only computed when k > 1
+            unique_ptr<bf::family_hash_function> h1, h2;
+        };
+
+        // the on-disk header, followed by one FileLevel per level and the bits, every
+        // section starting on a 64-byte boundary
+        struct FileHeader {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t numLevels;
+            uint64_t words;         // number of 64-bit words in the bits section
+            uint64_t levelsOffset;  // byte offset of the level table
+            uint64_t bitsOffset;    // byte offset of the bits
+            uint64_t checksum;      // of the level table and the bits
+            uint64_t reserved[2];
+        };
+
+        struct FileLevel {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t kind;
+            uint32_t k;             // of a BINARY_FUSE level: fingerprint bits | log2(segment length) << 8
+            uint64_t seed;
+            uint32_t salt;
+            uint32_t family;        // bf::hash_family, 0 (H3) in files written before families
+        };
+
+        static const uint64_t MAGIC = 0x315a524646424c4dULL;  // "MLBFFRZ1" on a little-endian host
+        static const uint32_t VERSION = 1;
+        static const size_t MAX_INFLIGHT = 64;
+
+        vector<Level> levels;
+        vector<Group> groups;
+        uint64_t* bits = nullptr;
+        size_t words = 0;
+        void* mapping = nullptr;    // the mapped file when loaded by the file constructor
+        size_t mappingSize = 0;
+
+        // replaces levels and groups by a level table over numWords words, false if it is invalid
+        // or its levels do not end in the last 8 words
+        bool setLevels(const FileLevel* table, uint32_t numLevels, uint64_t numWords);
+        // the level table as saved, padded to 64 bytes
+        vector<char> fileTable() const;
+        // the group of seed and family, added if it is new
+        uint32_t groupOf(size_t seed, bf::hash_family family, uint32_t k);
+        void makeHashers();
+        static void hash(const Group& group, void const* data, size_t size, uint64_t& h1, uint64_t& h2);
+        // whether the key of digests h1, h2 of the group of level passes level
+        bool hit(const Level& level, uint64_t h1, uint64_t h2) const;
+        // prefetches the cache lines hit reads
+        void prefetch(const Level& level, uint64_t h1, uint64_t h2) const;
+        static uint64_t checksum(const void* data, size_t size, uint64_t h);
+
+        FrozenMLBFilter(const FrozenMLBFilter&) = delete;
+        FrozenMLBFilter& operator=(const FrozenMLBFilter&) = delete;
+
+        // a mod d for any 64-bit a, with M = 2^128 / d rounded up (Lemire, Kaser, Kurz)
+        static inline uint64_t fastmod(uint64_t a, unsigned __int128 M, uint64_t d) {
+            unsigned __int128 lowbits = M * a;
+            unsigned __int128 bottom = ((lowbits & UINT64_MAX) * d) >> 64;
+            unsigned __int128 top = (lowbits >> 64) * d;
+            return (uint64_t) ((bottom + top) >> 64);
+        }
+
+        static inline bool test(const uint64_t* level, uint64_t pos) {
+            return (level[pos >> 6] >> (pos & 63)) & 1;
+        }
+
+    public:
+        // throws std::invalid_argument if a level was not built with double hashing
+        explicit FrozenMLBFilter(const MLBFilter& mlbf);
+
+        // maps a file written by save. the bits stay in the shared read-only mapping and are
+        // queried in place, verify checks the checksum first, reading the whole file once.
+        // throws std::runtime_error if the file cannot be mapped or is not a valid filter.
+        explicit FrozenMLBFilter(const string& path, bool verify = true);
+        ~FrozenMLBFilter();
+
+        // rebuilds a filter sent by pack. threads decode the chunks of the levels in parallel.
+        // throws std::invalid_argument if packed is malformed or does not produce its filter.
+        explicit FrozenMLBFilter(const vector<uint8_t>& packed, int threads = 1);
+
+        // writes the filter to path, throws std::runtime_error on failure
+        void save(const string& path) const;
+
+        // the checksum save stores, of the level table and the bits
+        uint64_t contentChecksum() const;
+
+        // the changes from one filter to another: the new level table and the XOR of the bits,
+        // as runs of unchanged words and literal words. small when the two builds keep their
+        // level sizes and seeds, see MLBFilter. BINARY_FUSE levels are solved anew by every
+        // build and change almost entirely.
+        static vector<uint8_t> delta(const FrozenMLBFilter& from, const FrozenMLBFilter& to);
+
+        // turns this filter into the to filter of a delta made from it. the bits are patched in
+        // place when the size is unchanged; a mapped filter is copied into memory first.
+        // throws std::invalid_argument if the delta is malformed or not made from this filter.
+        void applyDelta(const vector<uint8_t>& delta);
+
+        // the filter in transport form: the level table, then every level coded on its own as
+        // Golomb-Rice coded gaps between its set bits when that saves at least an eighth of its
+        // bytes, as its raw words otherwise. sparse levels, such as the deep levels of a cascade,
+        // shrink; dense levels and fingerprints are sent as they are and decode at copy speed.
+        vector<uint8_t> pack() const;
+
+        // contains: false means in S, true means in R
+        bool contains(void const* data, size_t size) const;
+
+        bool contains(const string& data) const {
+            return contains(data.data(), data.size());
+        }
+
+        // query n keys, bit i % 64 of out[i / 64] is set iff key i is in R, as in
+        // MLBFilter::containsBatch. up to inflight keys (at most 64) are interleaved: every one
+        // is tested at a level while the lines of the others' next levels are prefetched, so
+        // the cache misses of the level chains overlap.
+        void containsBatch(bf::object const* keys, size_t n, uint64_t* out, size_t inflight = 16) const;
+        void containsBatch(string const* const* keys, size_t n, uint64_t* out, size_t inflight = 16) const;
+
+        size_t bytesize() const {
+            return words * sizeof(uint64_t);
+        }
+};
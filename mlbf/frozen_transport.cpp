@@ -0,0 +1,368 @@
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include "frozen_mlbf.hpp"
+
+using namespace std;
+
+// A packed filter is a header, the level table and one record per level, then 8 zero bytes so
+// the decoder can always load a whole word. A level covers the words from its offset to the
+// next level's offset, padding included, and is cut into chunks of CHUNK_WORDS words that
+// decode on their own. A record is a varint of the coding, raw (0) or Rice (1) with the Rice
+// parameter shifted left by one, and a varint of the payload bytes. A Rice record then holds
+// two varints per chunk, its coded bits and its set bits, before the payload. A Rice chunk
+// codes the gap before every set bit, counted from the start of the chunk or the previous set
+// bit, as the quotient gap >> b in unary (zeros ended by a one) and the low b bits.
+namespace {
+
+const uint64_t PACK_MAGIC = 0x314b435046424c4dULL;  // "MLBFPCK1" on a little-endian host
+const uint64_t CHUNK_WORDS = 4096;
+const uint32_t MAX_RICE_BITS = 48;
+// a level is Rice coded only if that saves at least 1/RICE_MIN_SAVING of its raw bytes. Rice
+// decodes a set bit at a time, raw words are a copy, so a small saving costs more than it gains
+const uint64_t RICE_MIN_SAVING = 8;
+
+struct PackHeader {
+    uint64_t magic;
+    uint64_t checksum;      // contentChecksum of the filter
+    uint64_t words;
+    uint32_t numLevels;
+    uint32_t tableSize;     // bytes of the level table, numLevels FileLevels
+};
+
+void putVarint(vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t) v);
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// appends bits to out, least significant bit first
+class BitWriter {
+    private:
+        vector<uint8_t>& out;
+        uint64_t buffer = 0;
+        uint32_t used = 0;
+
+    public:
+        uint64_t written = 0;
+
+        explicit BitWriter(vector<uint8_t>& _out) : out(_out) {
+        }
+
+        // at most 32 bits at a time
+        void put(uint64_t v, uint32_t n) {
+            buffer |= v << used;
+            used += n;
+            written += n;
+            while (used >= 8) {
+                out.push_back((uint8_t) buffer);
+                buffer >>= 8;
+                used -= 8;
+            }
+        }
+
+        void putRice(uint64_t gap, uint32_t b) {
+            for (uint64_t q = gap >> b; q > 0; ) {
+                uint32_t zeros = (uint32_t) min<uint64_t>(q, 32);
+                put(0, zeros);
+                q -= zeros;
+            }
+            put(1, 1);
+            uint64_t low = b == 0 ? 0 : gap & ((1ULL << b) - 1);
+            put(low & 0xffffffff, min<uint32_t>(b, 32));
+            if (b > 32) {
+                put(low >> 32, b - 32);
+            }
+        }
+
+        void flush() {
+            if (used > 0) {
+                out.push_back((uint8_t) buffer);
+            }
+            buffer = 0;
+            used = 0;
+        }
+};
+
+// the up to 57 bits of data at bit, data is readable 8 bytes past bit / 8
+inline uint64_t peek(const uint8_t* data, uint64_t bit) {
+    uint64_t w;
+    memcpy(&w, data + (bit >> 3), sizeof(w));
+    return w >> (bit & 7);
+}
+
+// calls fn(word, gap) for every set bit of words [begin, end)
+template<class Fn>
+void forGaps(const uint64_t* bits, uint64_t begin, uint64_t end, Fn fn) {
+    uint64_t next = begin * 64;
+    for (uint64_t w = begin; w < end; w++) {
+        for (uint64_t x = bits[w]; x != 0; x &= x - 1) {
+            uint64_t pos = w * 64 + __builtin_ctzll(x);
+            fn(pos - next);
+            next = pos + 1;
+        }
+    }
+}
+
+// a chunk of a level as the decoder sees it
+struct Chunk {
+    uint64_t word;          // first word
+    uint64_t numWords;
+    const uint8_t* payload; // of the level
+    uint64_t bit;           // first coded bit in payload, or first byte of raw words
+    uint64_t endBit;
+    uint64_t ones;
+    uint32_t riceBits;
+    bool rice;
+};
+
+// decodes a chunk into its words, false if it is malformed
+bool decodeChunk(const Chunk& c, uint64_t* bits) {
+    uint64_t* out = bits + c.word;
+    if (!c.rice) {
+        memcpy(out, c.payload + c.bit, c.numWords * sizeof(uint64_t));
+        return true;
+    }
+    memset(out, 0, c.numWords * sizeof(uint64_t));
+    const uint8_t* data = c.payload;
+    uint64_t bit = c.bit;
+    uint64_t pos = 0;
+    uint64_t limit = c.numWords * 64;
+    uint64_t mask = c.riceBits == 0 ? 0 : (1ULL << c.riceBits) - 1;
+    for (uint64_t n = 0; n < c.ones; n++) {
+        uint64_t q = 0;
+        uint64_t w = peek(data, bit);
+        while (w == 0) {
+            // no one in the 57 bits at bit, a long gap or a malformed chunk
+            q += 57;
+            bit += 57;
+            if (bit >= c.endBit) {
+                return false;
+            }
+            w = peek(data, bit);
+        }
+        uint32_t zeros = __builtin_ctzll(w);
+        q += zeros;
+        bit += zeros + 1;
+        uint64_t low = peek(data, bit) & mask;
+        bit += c.riceBits;
+        if (bit > c.endBit || q > (limit >> c.riceBits)) {
+            return false;
+        }
+        pos += q << c.riceBits | low;
+        if (pos >= limit) {
+            return false;
+        }
+        out[pos >> 6] |= 1ULL << (pos & 63);
+        pos++;
+    }
+    return bit == c.endBit;
+}
+
+} // namespace
+
+vector<uint8_t> FrozenMLBFilter::pack() const {
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PACK_MAGIC;
+    header.checksum = contentChecksum();
+    header.words = words;
+    header.numLevels = levels.size();
+    header.tableSize = levels.size() * sizeof(FileLevel);
+
+    vector<char> table = fileTable();
+    vector<uint8_t> out(sizeof(header) + header.tableSize);
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), table.data(), header.tableSize);
+
+    for (size_t i = 0; i < levels.size(); i++) {
+        uint64_t begin = levels[i].offset;
+        uint64_t end = i + 1 < levels.size() ? levels[i + 1].offset : words;
+        uint64_t rawBytes = (end - begin) * sizeof(uint64_t);
+
+        // the Rice parameter of geometric gaps, 2^b near ln 2 times the mean gap, and its
+        // neighbours, priced exactly
+        uint64_t ones = 0;
+        for (uint64_t w = begin; w < end; w++) {
+            ones += __builtin_popcountll(bits[w]);
+        }
+        uint32_t bestBits = 0;
+        uint64_t bestCost = UINT64_MAX;
+        if (ones > 0) {
+            double mean = (end - begin) * 64.0 / ones;
+            int guess = (int) floor(log2(max(1.0, mean * log(2.0))));
+            for (int b = max(0, guess - 1); b <= min<int>(guess + 1, MAX_RICE_BITS); b++) {
+                uint64_t cost = 0;
+                forGaps(bits, begin, end, [&](uint64_t gap) {
+                    cost += (gap >> b) + 1 + b;
+                });
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestBits = b;
+                }
+            }
+        }
+
+        uint64_t riceLimit = rawBytes - rawBytes / RICE_MIN_SAVING;
+        vector<uint8_t> directory, payload;
+        if (bestCost / 8 < riceLimit) {
+            BitWriter writer(payload);
+            for (uint64_t chunk = begin; chunk < end; chunk += CHUNK_WORDS) {
+                uint64_t chunkEnd = min(end, chunk + CHUNK_WORDS);
+                uint64_t start = writer.written, set = 0;
+                forGaps(bits, chunk, chunkEnd, [&](uint64_t gap) {
+                    writer.putRice(gap, bestBits);
+                    set++;
+                });
+                putVarint(directory, writer.written - start);
+                putVarint(directory, set);
+            }
+            writer.flush();
+        }
+        if (!payload.empty() && directory.size() + payload.size() < riceLimit) {
+            putVarint(out, bestBits << 1 | 1);
+            putVarint(out, payload.size());
+            out.insert(out.end(), directory.begin(), directory.end());
+            out.insert(out.end(), payload.begin(), payload.end());
+        } else {
+            putVarint(out, 0);
+            putVarint(out, rawBytes);
+            size_t at = out.size();
+            out.resize(at + rawBytes);
+            memcpy(&out[at], bits + begin, rawBytes);
+        }
+    }
+    out.resize(out.size() + sizeof(uint64_t), 0);
+    return out;
+}
+
+FrozenMLBFilter::FrozenMLBFilter(const vector<uint8_t>& packed, int threads) {
+    if (packed.size() < sizeof(PackHeader) + sizeof(uint64_t)) {
+        throw invalid_argument("truncated packed MLBF");
+    }
+    PackHeader header;
+    memcpy(&header, packed.data(), sizeof(header));
+    // the last 8 bytes are padding, no level reaches them
+    const uint8_t* end = packed.data() + packed.size() - sizeof(uint64_t);
+    if (header.magic != PACK_MAGIC || header.tableSize != (uint64_t) header.numLevels * sizeof(FileLevel)
+        || header.tableSize > (size_t) (end - packed.data()) - sizeof(header)) {
+        throw invalid_argument("malformed packed MLBF");
+    }
+    vector<FileLevel> table(header.numLevels);
+    memcpy(table.data(), packed.data() + sizeof(header), header.tableSize);
+    bool valid = setLevels(table.data(), header.numLevels, header.words);
+    // the levels tile the words in order
+    valid = valid && (levels.empty() ? header.words == 0 : levels[0].offset == 0);
+    for (size_t i = 1; valid && i < levels.size(); i++) {
+        valid = levels[i].offset >= levels[i - 1].offset;
+    }
+    if (!valid) {
+        throw invalid_argument("malformed packed MLBF");
+    }
+
+    // the chunks of every level, checked against the records before any is decoded
+    vector<Chunk> chunks;
+    const uint8_t* p = packed.data() + sizeof(header) + header.tableSize;
+    for (size_t i = 0; valid && i < levels.size(); i++) {
+        uint64_t begin = levels[i].offset;
+        uint64_t last = i + 1 < levels.size() ? levels[i + 1].offset : header.words;
+        uint64_t coding, bytes;
+        valid = getVarint(p, end, coding) && getVarint(p, end, bytes);
+        if (valid && coding == 0) {
+            valid = bytes == (last - begin) * sizeof(uint64_t) && bytes <= (uint64_t) (end - p);
+            for (uint64_t w = begin; valid && w < last; w += CHUNK_WORDS) {
+                Chunk c;
+                c.word = w;
+                c.numWords = min(last, w + CHUNK_WORDS) - w;
+                c.payload = p;
+                c.bit = (w - begin) * sizeof(uint64_t);
+                c.endBit = c.ones = c.riceBits = 0;
+                c.rice = false;
+                chunks.push_back(c);
+            }
+            p += valid ? bytes : 0;
+        } else if (valid) {
+            uint32_t riceBits = coding >> 1;
+            valid = (coding & 1) && riceBits <= MAX_RICE_BITS && bytes <= (uint64_t) (end - p);
+            size_t first = chunks.size();
+            uint64_t bit = 0;
+            for (uint64_t w = begin; valid && w < last; w += CHUNK_WORDS) {
+                uint64_t length = 0, ones = 0;
+                valid = getVarint(p, end, length) && getVarint(p, end, ones) && length <= bytes * 8 - bit;
+                Chunk c;
+                c.word = w;
+                c.numWords = min(last, w + CHUNK_WORDS) - w;
+                c.bit = bit;
+                c.endBit = bit + length;
+                c.ones = ones;
+                c.riceBits = riceBits;
+                c.rice = true;
+                // every set bit takes at least riceBits + 1 coded bits
+                valid = valid && ones <= c.numWords * 64 && ones <= length / (riceBits + 1);
+                chunks.push_back(c);
+                bit += length;
+            }
+            valid = valid && (bit + 7) / 8 == bytes && bytes <= (uint64_t) (end - p);
+            for (size_t c = first; valid && c < chunks.size(); c++) {
+                chunks[c].payload = p;
+            }
+            p += valid ? bytes : 0;
+        }
+    }
+    if (!valid || p != end) {
+        throw invalid_argument("malformed packed MLBF");
+    }
+
+    if (posix_memalign((void**) &bits, 64, max<size_t>(header.words, 1) * sizeof(uint64_t)) != 0) {
+        throw bad_alloc();
+    }
+    words = header.words;
+    // every thread decodes every threads-th chunk, the chunks cover distinct words
+    threads = max(1, min<int>(threads, chunks.size()));
+    vector<char> decoded(threads, 1);
+    auto decode = [&](int t) {
+        for (size_t c = t; c < chunks.size(); c += threads) {
+            if (!decodeChunk(chunks[c], bits)) {
+                decoded[t] = 0;
+                return;
+            }
+        }
+    };
+    if (threads == 1) {
+        decode(0);
+    } else {
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back(decode, t);
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+    valid = count(decoded.begin(), decoded.end(), 0) == 0;
+    if (valid) {
+        makeHashers();
+        valid = contentChecksum() == header.checksum;
+    }
+    if (!valid) {
+        free(bits);
+        throw invalid_argument("packed MLBF does not produce its filter");
+    }
+}
@@ -1,89 +1,380 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
 #include "mlbf.hpp"
+#include "planner.hpp"
 
 using bf::basic_bloom_filter;
 using namespace std;
 
-bool MLBFilter::build() {
+bool MLBFilter::verbose = false;
+
+// levels in a row that let every checked key through before the build gives up, see build
+static const size_t MAX_STALLED_LEVELS = 64;
+
+// seeds an exact level tries before the build gives up, see newExactLevel
+static const size_t MAX_EXACT_TRIALS = 16;
+
+// throws for the keys of to_check that no level tells from keys of to_insert: the same key on
+// both sides, or keys with equal digests, which every salt remixes alike
+static void throwInseparable(const vector<string>& insert_keys, const vector<uint32_t>& to_insert,
+                             const vector<string>& check_keys, const vector<uint32_t>& to_check) {
+    unordered_set<string> inserted;
+    for (uint32_t i : to_insert) {
+        inserted.insert(insert_keys[i]);
+    }
+    size_t both = 0;
+    for (uint32_t i : to_check) {
+        both += inserted.count(check_keys[i]);
+    }
+    if (both > 0) {
+        throw invalid_argument("MLBFilter: " + to_string(both) + " keys are in both R and S");
+    }
+    throw invalid_argument("MLBFilter: " + to_string(to_check.size()) + " keys hash like keys of the other side, no level separates them");
+}
+
+// runs fn(begin, end, t) for up to threads slices of [0, n), slices are at least MIN_SLICE long
+template<class Fn>
+static int parallelFor(int threads, size_t n, Fn fn) {
+    const size_t MIN_SLICE = 4096;
+    threads = max(1, min<int>(threads, (n + MIN_SLICE - 1) / MIN_SLICE));
+    if (threads == 1) {
+        fn(0, n, 0);
+        return 1;
+    }
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back(fn, n * t / threads, n * (t + 1) / threads, t);
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    return threads;
+}
+
+bool MLBFilter::build(const vector<string>& revoked, const vector<string>& stay) {
+    // the first two functions bf::make_static_hasher derives from seed 0, see newLevel
+    minstd_rand0 prng(0);
+    hash1.reset(new bf::family_hash_function(family, prng()));
+    hash2.reset(new bf::family_hash_function(family, prng()));
+
     int r_remain = rCapacity;
     int s_remain = sCapacity;
-    vector<string>* to_insert;
-    vector<string>* to_check;
+    // the keys still in play on each side, as indices into revoked and stay.
+    // the false positives of a level are moved to the front of the checked side in place.
+    vector<uint32_t> r_index(revoked.size());
+    vector<uint32_t> s_index(stay.size());
+    for (uint32_t i = 0; i < r_index.size(); i++) r_index[i] = i;
+    for (uint32_t i = 0; i < s_index.size(); i++) s_index[i] = i;
+    const vector<string>* insert_keys;
+    const vector<string>* check_keys;
+    vector<uint32_t>* to_insert;
+    vector<uint32_t>* to_check;
     int n;
     float curFpRate;
+    uint32_t k = 0;
+    FilterKind kind;
+    double reached = 0, probed = 0;
+    size_t stalled = 0;
 
     for (int level=1; ; level++) {
         // cout << "Level" << level << " revoked remain " << r_remain << " stay remain " << s_remain << endl;  
-        if (level == 1) {
-            curFpRate = firstFpRate;
+        size_t plannedCapacity = 0;
+        if (!requestedPlan.levels.empty()) {
+            const MLBFLevelPlan& planned = requestedPlan.levels[min<size_t>(level - 1, requestedPlan.levels.size() - 1)];
+            curFpRate = planned.fpRate;
+            k = planned.k;
+            kind = planned.kind;
+            if ((size_t) level <= requestedPlan.levels.size()) {
+                plannedCapacity = planned.capacity;
+            }
         } else {
-            curFpRate = baseFpRate;
+            curFpRate = level == 1 ? firstFpRate : baseFpRate;
+            kind = kinds.empty() ? BASIC_BLOOM : kinds[min(mlbfilters.size(), kinds.size() - 1)];
         }
         if (level % 2 == 1) {
             n = r_remain;
-            to_insert = &revoked; 
-            to_check = &stay;
+            to_insert = &r_index;
+            insert_keys = &revoked;
+            to_check = &s_index;
+            check_keys = &stay;
             s_remain = round(curFpRate * s_remain);
         } else {
             n = s_remain;
-            to_insert = &stay;
-            to_check = &revoked;
+            to_insert = &s_index;
+            insert_keys = &stay;
+            to_check = &r_index;
+            check_keys = &revoked;
             r_remain = round(curFpRate * r_remain);
         }
 
-        cout << "Level" << level << " to_check " << to_check->size() << " to_insert " << to_insert->size() << endl;
-
-        if (n < 100) {
-            n = to_insert->size() + to_check->size(); // speed up for last several level
+        if (verbose) {
+            cout << "Level" << level << " to_check " << to_check->size() << " to_insert " << to_insert->size() << endl;
         }
 
-        mlbfilters.emplace_back(curFpRate, n); // a desired false-positive probability and capacity
-        //mlbfilters.emplace_back(baseFpRate, to_check->size() + to_insert->size());      
+        if (kind == EXACT_SET || (residual > 0 && to_insert->size() <= residual) || (maxLevels > 0 && (size_t) level >= maxLevels)) {
+            // the last level holds the keys to insert exactly and no key to check passes it. a
+            // layout() of an exact-tail build plans it as an EXACT_SET level
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            fingerprint_set* exact = newExactLevel(*insert_keys, *to_insert, *check_keys, *to_check);
+            mlbfilters.emplace_back(exact);
+            mlbfilterKinds.push_back(EXACT_SET);
+            MLBFLevelPlan built;
+            built.kind = EXACT_SET;
+            built.fpRate = 0;
+            built.k = 1;
+            built.capacity = exact->count();
+            built.bits = exact->size() * 8;
+            // newExactLevel checks the keys of the other side while it builds
+            built.insertMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            builtPlan.levels.push_back(built);
+            builtPlan.bits += built.bits;
+            reached += to_insert->size() + to_check->size();
+            probed += MLBFPlanner::probes(EXACT_SET, 1, 0, to_insert->size(), to_check->size());
+            builtPlan.expectedDepth = reached / (revoked.size() + stay.size());
+            builtPlan.expectedProbes = probed / (revoked.size() + stay.size());
+            if (verbose) {
+                cout << "Level" << level << " exact, " << exact->count() << " fingerprints" << endl;
+            }
+            break;
+        }
 
-        for (vector<string>::iterator it = to_insert->begin(); it != to_insert->end(); ++it){
-            mlbfilters.back().add(*it);
+        if (!requestedPlan.levels.empty()) {
+            // a plan sizes every level for its actual keys, or for its planned capacity if that
+            // is larger, so a rebuild from the layout of an earlier build keeps the level sizes
+            n = max<size_t>(1, max(to_insert->size(), plannedCapacity));
+        } else if (n < 100) {
+            n = to_insert->size() + to_check->size(); // speed up for last several level
         }
 
-        vector<string> fps;
-        for (vector<string>::iterator it = to_check->begin(); it != to_check->end(); ++it){
-            if (mlbfilters.back().lookup(*it)) {
-                fps.push_back(*it);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        // every level and trial has its own salt, the first trial of level i uses salt i.
+        // with several trials the level that passes the fewest keys on is kept.
+        unique_ptr<bf::bloom_filter> best;
+        size_t leastFps = SIZE_MAX;
+        for (int trial = 0; trial < saltTrials; trial++) {
+            size_t salt = mlbfilters.size() + ((size_t) trial << 16);
+            unique_ptr<bf::bloom_filter> candidate(newLevel(kind, curFpRate, n, k, salt)); // a desired false-positive probability and capacity
+            //mlbfilters.emplace_back(baseFpRate, to_check->size() + to_insert->size());      
+            bf::bloom_filter& filter = *candidate;
+            if (kind == BASIC_BLOOM) {
+                // bulk insertion partitions the bits of the keys so each part of a large level
+                // is set while it is in cache
+                vector<bf::object> objects;
+                objects.reserve(to_insert->size());
+                for (uint32_t i : *to_insert) {
+                    objects.emplace_back((*insert_keys)[i].data(), (*insert_keys)[i].size());
+                }
+                static_cast<basic_bloom_filter&>(filter).add_all(objects, threads);
+            } else {
+                // a fuse level collects the digests of its keys and solves its slots once
+                int inserters = kind == BINARY_FUSE ? 1 : threads;
+                parallelFor(inserters, to_insert->size(), [&](size_t begin, size_t end, int t) {
+                    for (size_t i = begin; i < end; i++) {
+                        insert(filter, kind, (*insert_keys)[(*to_insert)[i]], inserters > 1);
+                    }
+                });
+            }
+            if (kind == BINARY_FUSE) {
+                static_cast<binary_fuse_filter&>(filter).build();
+            }
+            if (saltTrials == 1) {
+                best = move(candidate);
+                break;
+            }
+            vector<size_t> counts(threads, 0);
+            int used = parallelFor(threads, to_check->size(), [&](size_t begin, size_t end, int t) {
+                for (size_t i = begin; i < end; i++) {
+                    counts[t] += filter.lookup((*check_keys)[(*to_check)[i]]);
+                }
+            });
+            size_t trialFps = 0;
+            for (int t = 0; t < used; t++) {
+                trialFps += counts[t];
+            }
+            if (trialFps < leastFps) {
+                leastFps = trialFps;
+                best = move(candidate);
             }
         }
+        mlbfilters.push_back(move(best));
+        mlbfilterKinds.push_back(kind);
+        bf::bloom_filter& filter = *mlbfilters.back();
+        chrono::steady_clock::time_point inserted = chrono::steady_clock::now();
 
-        if ( fps.size() <= 1 || to_check->size() <= 1 || to_insert->size() <= 1) {
-            break;
+        // every thread compacts the false positives of its slice to the front of the slice,
+        // then the slices are moved together in order
+        vector<pair<size_t, size_t>> slices(threads);
+        int used = parallelFor(threads, to_check->size(), [&](size_t begin, size_t end, int t) {
+            size_t out = begin;
+            for (size_t i = begin; i < end; i++) {
+                if (filter.lookup((*check_keys)[(*to_check)[i]])) {
+                    (*to_check)[out++] = (*to_check)[i];
+                }
+            }
+            slices[t] = make_pair(begin, out);
+        });
+        size_t fps = 0;
+        for (int t = 0; t < used; t++) {
+            size_t cnt = slices[t].second - slices[t].first;
+            memmove(&(*to_check)[fps], &(*to_check)[slices[t].first], cnt * sizeof(uint32_t));
+            fps += cnt;
         }
+        chrono::steady_clock::time_point checked = chrono::steady_clock::now();
 
-        if (level % 2 == 1) {
-            stay = fps;
+        MLBFLevelPlan built;
+        built.kind = kind;
+        built.fpRate = curFpRate;
+        built.capacity = n;
+        if (kind == BLOCKED_BLOOM) {
+            const blocked_bloom_filter& blocked = static_cast<const blocked_bloom_filter&>(filter);
+            built.k = blocked.num_hashes();
+            built.bits = blocked.size() * 8;
+        } else if (kind == BINARY_FUSE) {
+            const binary_fuse_filter& fuse = static_cast<const binary_fuse_filter&>(filter);
+            built.k = fuse.bits();
+            built.bits = fuse.size() * 8;
         } else {
-            revoked = fps;
+            const basic_bloom_filter& basic = static_cast<const basic_bloom_filter&>(filter);
+            built.k = basic.num_hashes();
+            built.bits = basic.storage().size();
+        }
+        built.insertMs = chrono::duration<double, milli>(inserted - start).count();
+        built.checkMs = chrono::duration<double, milli>(checked - inserted).count();
+        builtPlan.levels.push_back(built);
+        builtPlan.bits += built.bits;
+        reached += to_insert->size() + to_check->size();
+        probed += MLBFPlanner::probes(kind, built.k, curFpRate, to_insert->size() + fps, to_check->size() - fps);
+        builtPlan.expectedDepth = reached / (revoked.size() + stay.size());
+        builtPlan.expectedProbes = probed / (revoked.size() + stay.size());
+        if (verbose) {
+            cout << "Level" << level << " k " << built.k << " insert " << built.insertMs << "ms check " << built.checkMs << "ms" << endl;
+        }
+
+        // every level has its own salt, so keys that collide at one level are placed
+        // independently at the next. the salt only remixes the digests: a key on both sides, or
+        // keys with equal digests, pass every level of the other side, and a long run of levels
+        // that let every checked key through means only such keys are left
+        if (fps == 0) {
+            break;
+        }
+        stalled = fps == to_check->size() ? stalled + 1 : 0;
+        to_check->resize(fps);
+        if (stalled == MAX_STALLED_LEVELS) {
+            throwInseparable(*insert_keys, *to_insert, *check_keys, *to_check);
         }
     }
     return true;
 } 
 
 
-MLBFilter::MLBFilter(int _rCapacity, int _sCapacity, vector<string> _revoked, vector<string> _stay, float _firstFpRate, float _baseFpRate) {
+bf::bloom_filter* MLBFilter::newLevel(FilterKind kind, float fpRate, int capacity, uint32_t k, size_t salt) {
+    // all levels share the hash functions of seed 0, the salt remixes their digests
+    if (kind == BLOCKED_BLOOM) {
+        return new blocked_bloom_filter(fpRate, capacity, k, 0, salt, family);
+    }
+    if (kind == BINARY_FUSE) {
+        return new binary_fuse_filter(fpRate, capacity, 0, salt, family);
+    }
+    if (kind == EXACT_SET) {
+        throw invalid_argument("MLBFilter: an EXACT_SET level is built from its keys, see newExactLevel");
+    }
+    return new basic_bloom_filter(fpRate, capacity, 0, true, k, salt, family);
+}
+
+fingerprint_set* MLBFilter::newExactLevel(const vector<string>& insert_keys, const vector<uint32_t>& to_insert,
+                                          const vector<string>& check_keys, const vector<uint32_t>& to_check) {
+    vector<bf::object> objects;
+    objects.reserve(to_insert.size());
+    for (uint32_t i : to_insert) {
+        objects.emplace_back(insert_keys[i].data(), insert_keys[i].size());
+    }
+    // a key to check matches a fingerprint when its digest equals one of a key to insert, which
+    // no salt changes, see bf::remix. 64-bit digests of few keys practically never collide, so
+    // another seed fixes it; a collision under every seed is the same key on both sides
+    vector<uint32_t> collided;
+    for (size_t trial = 0; trial < MAX_EXACT_TRIALS; trial++) {
+        unique_ptr<fingerprint_set> exact(new fingerprint_set(trial, mlbfilters.size(), family));
+        exact->add_all(objects);
+        collided.clear();
+        for (uint32_t i : to_check) {
+            if (exact->lookup(check_keys[i])) {
+                collided.push_back(i);
+            }
+        }
+        if (collided.empty()) {
+            return exact.release();
+        }
+    }
+    throwInseparable(insert_keys, to_insert, check_keys, collided);
+    return nullptr;
+}
+
+void MLBFilter::insert(bf::bloom_filter& filter, FilterKind kind, const string& key, bool concurrent) {
+    if (!concurrent || kind == EXACT_SET || kind == BINARY_FUSE) {
+        filter.add(key);
+    } else if (kind == BLOCKED_BLOOM) {
+        static_cast<blocked_bloom_filter&>(filter).add_concurrent(key);
+    } else {
+        static_cast<basic_bloom_filter&>(filter).add_concurrent(key);
+    }
+}
+
+
+MLBFilter::MLBFilter(int _rCapacity, int _sCapacity, const vector<string>& _revoked, const vector<string>& _stay, float _firstFpRate, float _baseFpRate, int _threads,
+                     const vector<FilterKind>& _kinds, int _saltTrials, size_t _residual, size_t _maxLevels,
+                     bf::hash_family _family) {
     rCapacity = _rCapacity;
     sCapacity = _sCapacity;
-    revoked = _revoked;
-    stay = _stay;
     firstFpRate = _firstFpRate;
     baseFpRate = _baseFpRate;
+    threads = max(1, _threads);
+    kinds = _kinds;
+    saltTrials = max(1, _saltTrials);
+    residual = _residual;
+    maxLevels = _maxLevels;
+    family = _family;
 
-    build();
+    build(_revoked, _stay);
 };
 
+MLBFilter::MLBFilter(const vector<string>& _revoked, const vector<string>& _stay, const MLBFPlan& _plan, int _threads, int _saltTrials,
+                     size_t _residual, size_t _maxLevels, bf::hash_family _family) {
+    rCapacity = _revoked.size();
+    sCapacity = _stay.size();
+    firstFpRate = _plan.levels.empty() ? 0.5 : _plan.levels.front().fpRate;
+    baseFpRate = _plan.levels.size() < 2 ? firstFpRate : _plan.levels[1].fpRate;
+    threads = max(1, _threads);
+    saltTrials = max(1, _saltTrials);
+    residual = _residual;
+    maxLevels = _maxLevels;
+    family = _family;
+    requestedPlan = _plan;
+    for (const MLBFLevelPlan& level : _plan.levels) {
+        kinds.push_back(level.kind);
+    }
+
+    build(_revoked, _stay);
+}
+
 
-bool MLBFilter::contains(string data) {
+bool MLBFilter::contains(const string& data) const {
+    return contains(data.data(), data.size());
+}
+
+bool MLBFilter::contains(void const* data, size_t size) const {
     // contains: false means in S, true means in R
+    bf::object o(data, size);
     bool included = false;
-    for (vector<basic_bloom_filter>::iterator filter = mlbfilters.begin(); filter != mlbfilters.end(); ++filter){
-        if (filter->lookup(data)) {
+    for (vector<unique_ptr<bf::bloom_filter>>::const_iterator filter = mlbfilters.begin(); filter != mlbfilters.end(); ++filter){
+        if ((*filter)->lookup(o)) {
             included = !included;
         } else {
             return included;
@@ -99,10 +390,146 @@ bool MLBFilter::contains(string data) {
     }
 }
 
+bool MLBFilter::levelHit(size_t i, const bf::object& o, uint64_t d1, uint64_t d2) const {
+    const bf::bloom_filter& filter = *mlbfilters[i];
+    FilterKind kind = mlbfilterKinds[i];
+    if (kind == BLOCKED_BLOOM) {
+        const blocked_bloom_filter& level = static_cast<const blocked_bloom_filter&>(filter);
+        uint64_t x = blocked_bloom_filter::remix(d1, level.salt());
+        uint64_t mask[blocked_bloom_filter::block_words];
+        blocked_bloom_filter::make_mask(x, level.num_hashes(), mask);
+        return blocked_bloom_filter::test(level.data() + blocked_bloom_filter::block_of(x, level.blocks())
+                                          * blocked_bloom_filter::block_words, mask);
+    } else if (kind == BINARY_FUSE) {
+        const binary_fuse_filter& level = static_cast<const binary_fuse_filter&>(filter);
+        return binary_fuse_filter::test(level.data(), level.bits(), level.segment_length(),
+                                        level.num_slots() - 2 * level.segment_length(), bf::remix(d1, level.salt()));
+    } else if (kind == EXACT_SET) {
+        const fingerprint_set& level = static_cast<const fingerprint_set&>(filter);
+        if (level.seed() != 0) {
+            // not derived from d1
+            return level.lookup(o) != 0;
+        }
+        return fingerprint_set::find(level.data(), level.count(), fingerprint_set::fingerprint(d1, level.salt()));
+    }
+    const basic_bloom_filter& level = static_cast<const basic_bloom_filter&>(filter);
+    size_t k = level.num_hashes();
+    if (!level.double_hashing() || k == 0 || k > bf::default_static_hasher::max_k) {
+        // not derived from d1, d2
+        return level.lookup(o) != 0;
+    }
+    if (level.salt() != 0) {
+        d1 = bf::remix(d1, level.salt());
+        d2 = k > 1 ? bf::remix(d2, level.salt()) : 0;
+    }
+    // all k bits are loaded, none of the loads waits for another
+    const bf::bitvector& bits = level.storage();
+    const bf::bitvector::block_type* blocks = bits.data();
+    uint64_t all = 1;
+    for (size_t j = 0; j < k; j++) {
+        size_t pos = (d1 + j * d2) % bits.size();
+        all &= blocks[pos / bf::bitvector::bits_per_block] >> (pos % bf::bitvector::bits_per_block);
+    }
+    return all != 0;
+}
+
+bool MLBFilter::containsUpFront(const string& data, size_t window) const {
+    return containsUpFront(data.data(), data.size(), window);
+}
+
+bool MLBFilter::containsUpFront(void const* data, size_t size, size_t window) const {
+    bf::object o(data, size);
+    uint64_t d1 = (*hash1)(o);
+    // only basic levels double hash
+    bool basic = find(mlbfilterKinds.begin(), mlbfilterKinds.end(), BASIC_BLOOM) != mlbfilterKinds.end();
+    uint64_t d2 = basic ? (*hash2)(o) : 0;
+    window = max<size_t>(1, min<size_t>(window, 64));
+    // bit i - first of missed is set iff level i misses
+    for (size_t first = 0; first < mlbfilters.size(); first += window) {
+        size_t last = min(mlbfilters.size(), first + window);
+        uint64_t missed = 0;
+        for (size_t i = first; i < last; i++) {
+            missed |= (uint64_t) !levelHit(i, o, d1, d2) << (i - first);
+        }
+        if (missed != 0) {
+            // passed the levels before the first miss, an odd number of them answers R
+            return (first + __builtin_ctzll(missed)) % 2 == 1;
+        }
+    }
+    return mlbfilters.size() % 2 == 1;
+}
+
+void MLBFilter::containsBatch(bf::object const* keys, size_t n, uint64_t* out) const {
+    // 64 keys at a time, one output word each. the keys still undecided at a level are
+    // kept in active, so every level is probed for all of them before the next level.
+    // basic levels test the active keys with basic_bloom_filter::lookup_batch
+    uint8_t active[64];
+    vector<bf::object> objects;
+    objects.reserve(64);
+    for (size_t base = 0; base < n; base += 64) {
+        size_t cnt = min<size_t>(64, n - base);
+        for (size_t i = 0; i < cnt; i++) {
+            active[i] = i;
+        }
+        uint64_t word = 0;
+        size_t remain = cnt;
+        for (size_t level = 0; level < mlbfilters.size() && remain > 0; level++) {
+            const bf::bloom_filter& filter = *mlbfilters[level];
+            uint64_t hits = 0;
+            bool batched = mlbfilterKinds[level] == BASIC_BLOOM;
+            if (batched) {
+                objects.clear();
+                for (size_t i = 0; i < remain; i++) {
+                    objects.push_back(keys[base + active[i]]);
+                }
+                static_cast<const basic_bloom_filter&>(filter).lookup_batch(objects.data(), remain, &hits);
+            }
+            size_t next = 0;
+            for (size_t i = 0; i < remain; i++) {
+                if (batched ? (hits >> i & 1) : filter.lookup(keys[base + active[i]])) {
+                    active[next++] = active[i];
+                } else if (level % 2 == 1) {
+                    // missed an even level (1-based), the key passed an odd number of levels: in R
+                    word |= 1ULL << active[i];
+                }
+            }
+            remain = next;
+        }
+        if (mlbfilters.size() % 2 == 1) {
+            // passed every level
+            for (size_t i = 0; i < remain; i++) {
+                word |= 1ULL << active[i];
+            }
+        }
+        out[base / 64] = word;
+    }
+}
+
+void MLBFilter::containsBatch(string const* const* keys, size_t n, uint64_t* out) const {
+    vector<bf::object> objects;
+    objects.reserve(min<size_t>(n, 1024));
+    for (size_t base = 0; base < n; base += 1024) {
+        size_t cnt = min<size_t>(1024, n - base);
+        objects.clear();
+        for (size_t i = 0; i < cnt; i++) {
+            objects.emplace_back(keys[base + i]->data(), keys[base + i]->size());
+        }
+        containsBatch(objects.data(), cnt, out + base / 64);
+    }
+}
+
 size_t MLBFilter::bytesize() {
     size_t size = 0;
-    for (vector<basic_bloom_filter>::iterator filter = mlbfilters.begin(); filter != mlbfilters.end(); ++filter){
-        size += filter->size();
+    for (size_t i = 0; i < mlbfilters.size(); i++) {
+        if (mlbfilterKinds[i] == BLOCKED_BLOOM) {
+            size += static_cast<blocked_bloom_filter&>(*mlbfilters[i]).size();
+        } else if (mlbfilterKinds[i] == EXACT_SET) {
+            size += static_cast<fingerprint_set&>(*mlbfilters[i]).size();
+        } else if (mlbfilterKinds[i] == BINARY_FUSE) {
+            size += static_cast<binary_fuse_filter&>(*mlbfilters[i]).size();
+        } else {
+            size += static_cast<basic_bloom_filter&>(*mlbfilters[i]).size();
+        }
     }
     return size;
 }
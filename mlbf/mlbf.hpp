@@ -1,29 +1,160 @@
 #pragma once
 
 #include "bf/basic.h"
+#include "bf/blocked.h"
+#include "bf/fingerprint.h"
+#include "bf/fuse.h"
 #include <cmath>
 #include <deque>
+#include <cstdint>
+#include <memory>
 
 using bf::basic_bloom_filter;
+using bf::blocked_bloom_filter;
+using bf::fingerprint_set;
+using bf::binary_fuse_filter;
 using namespace std;
 
+// the Bloom filter type of a level
+enum FilterKind {
+    BASIC_BLOOM,    // bf::basic_bloom_filter, k probes over the whole level
+    BLOCKED_BLOOM,  // bf::blocked_bloom_filter, k probes in one cache line
+    EXACT_SET,      // bf::fingerprint_set, the exact last level of a cascade cut short
+    BINARY_FUSE     // bf::binary_fuse_filter, 3 probes, built once all keys of the level are added
+};
+
+// the parameters of one level of a cascade
+struct MLBFLevelPlan {
+    FilterKind kind;
+    double fpRate;          // false-positive rate the level is sized for
+    uint32_t k;             // number of hash functions, fingerprint bits of a BINARY_FUSE level
+    uint64_t capacity;      // number of keys inserted
+    uint64_t bits;          // size of the level
+    double insertMs = 0;    // time to build the level from its keys, recorded by MLBFilter
+    double checkMs = 0;     // time to look up the keys of the other side, recorded by MLBFilter
+};
+
+// a cascade layout: predicted by MLBFPlanner, or recorded by MLBFilter while it builds
+struct MLBFPlan {
+    vector<MLBFLevelPlan> levels;
+    double bits = 0;            // total size
+    double expectedDepth = 0;   // levels a query reaches, averaged over R and S
+    double expectedProbes = 0;  // cache lines a query touches, averaged over R and S
+};
+
 class MLBFilter {
     private:
         int rCapacity;
         int sCapacity;
-        vector<string> revoked;
-        vector<string> stay;
         float firstFpRate;
         float baseFpRate;
-        vector<basic_bloom_filter> mlbfilters;
+        int threads;
+        int saltTrials;             // salts tried per level
+        size_t residual;            // keys left for an exact last level, 0 for none
+        size_t maxLevels;           // levels including the exact one, 0 for no limit
+        bf::hash_family family;     // hash functions of all levels
+        vector<FilterKind> kinds;   // requested kind of every level, the last one repeats
+        vector<unique_ptr<bf::bloom_filter>> mlbfilters;
+        vector<FilterKind> mlbfilterKinds;
+        MLBFPlan requestedPlan;     // empty when built from fixed fp rates
+        MLBFPlan builtPlan;
+        // the hash functions of seed 0, every level derives its positions from their digests
+        unique_ptr<bf::family_hash_function> hash1, hash2;
+
+        // a level of kind, throws invalid_argument for EXACT_SET, see newExactLevel
+        bf::bloom_filter* newLevel(FilterKind kind, float fpRate, int capacity, uint32_t k, size_t salt);
+        // the fingerprints of the keys to insert, under the first seed none of the keys to check
+        // matches. throws invalid_argument if no seed separates them, see build
+        fingerprint_set* newExactLevel(const vector<string>& insert_keys, const vector<uint32_t>& to_insert,
+                                       const vector<string>& check_keys, const vector<uint32_t>& to_check);
+        void insert(bf::bloom_filter& filter, FilterKind kind, const string& key, bool concurrent);
+        // whether level i contains the key of object o and digests d1, d2, without branching
+        // on the bits it loads
+        bool levelHit(size_t i, const bf::object& o, uint64_t d1, uint64_t d2) const;
     
-        bool build();
+        bool build(const vector<string>& revoked, const vector<string>& stay);
 
     public:
-        MLBFilter(int _rCapacity, int _sCapacity, vector<string> _revoked, vector<string> _stay, float firstFpRate, float _baseFpRate);
+        // print the keys, k and build times of every level to stdout while building, off by default
+        static bool verbose;
+
+        // the keys are only borrowed during construction, the filter keeps no copy of them.
+        // _threads threads insert and check the keys of every level.
+        // level i uses _kinds[i], levels past the end repeat the last kind, basic Bloom filters by default.
+        // all levels hash with one seed, each remixes the digests with its own salt. with _saltTrials > 1
+        // every level is built with that many salts and the one passing the fewest keys on is kept.
+        // once at most _residual keys are left to insert, or the cascade reaches _maxLevels levels, the
+        // keys left go to an exact EXACT_SET level and the cascade ends; contains then visits at most
+        // _maxLevels levels. 0 disables either limit. the exact level takes another seed if keys of
+        // the two sides collide in it. _family picks the hash functions.
+        // a key in both R and S cannot be told apart by any level and throws invalid_argument, so
+        // do keys of the two sides with equal digests unless an exact level separates them.
+        MLBFilter(int _rCapacity, int _sCapacity, const vector<string>& _revoked, const vector<string>& _stay, float firstFpRate, float _baseFpRate, int _threads = 1,
+                  const vector<FilterKind>& _kinds = vector<FilterKind>(), int _saltTrials = 1, size_t _residual = 0, size_t _maxLevels = 0,
+                  bf::hash_family _family = bf::hash_family::h3);
+
+        // builds the levels of a plan, see MLBFPlanner. a level is sized for its planned capacity,
+        // or for the keys actually inserted if there are more, levels past the end of the plan
+        // repeat its last level and are sized for their keys. level i has salt i, so building
+        // again from the layout() of an earlier build keeps salts and most level sizes, and the
+        // frozen filters of the two builds differ in few bits. an EXACT_SET level in the plan
+        // takes the keys left and ends the cascade.
+        MLBFilter(const vector<string>& _revoked, const vector<string>& _stay, const MLBFPlan& _plan, int _threads = 1, int _saltTrials = 1,
+                  size_t _residual = 0, size_t _maxLevels = 0, bf::hash_family _family = bf::hash_family::h3);
+
+        // contains: false means in S, true means in R
+        bool contains(const string& data) const;
 
-        bool contains(string data);
+        // non-owning query of size bytes at data, no copy of the key
+        bool contains(void const* data, size_t size) const;
+
+        // same answer as contains, but levels are tested window at a time (at most 64), all of
+        // them by default: the key is hashed once, the positions of all levels follow from its
+        // digests, and the loads of a window are issued before any result is used. the first
+        // level that misses is found from a bitmask of the window, so a query waits for about one
+        // memory round trip per window instead of one per level it reaches, at the price of
+        // probing levels contains would not reach.
+        bool containsUpFront(const string& data, size_t window = 64) const;
+        bool containsUpFront(void const* data, size_t size, size_t window = 64) const;
+
+        // query n keys, bit i % 64 of out[i / 64] is set iff key i is in R.
+        // out must hold (n + 63) / 64 words. keys are tested level by level, a key leaves the
+        // batch at the first level that does not contain it, as in contains.
+        void containsBatch(bf::object const* keys, size_t n, uint64_t* out) const;
+        void containsBatch(string const* const* keys, size_t n, uint64_t* out) const;
 
         size_t bytesize();
 
+        size_t numLevels() const {
+            return mlbfilters.size();
+        }
+
+        // the filter of a level, level 1 is index 0. levelKind tells its type.
+        const bf::bloom_filter& level(size_t i) const {
+            return *mlbfilters[i];
+        }
+
+        FilterKind levelKind(size_t i) const {
+            return mlbfilterKinds[i];
+        }
+
+        // adds key to the filter of level i. the caller keeps the cascade exact, see MLBFUpdater.
+        void addToLevel(size_t i, const string& key) {
+            insert(*mlbfilters[i], mlbfilterKinds[i], key, false);
+        }
+
+        bf::hash_family hashFamily() const {
+            return family;
+        }
+
+        // the plan the filter was constructed from, empty for fixed fp rates
+        const MLBFPlan& plan() const {
+            return requestedPlan;
+        }
+
+        // the levels as built, with the actual capacities, sizes and build times
+        const MLBFPlan& layout() const {
+            return builtPlan;
+        }
+
 };
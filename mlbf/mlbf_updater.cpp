@@ -0,0 +1,132 @@
+#include <algorithm>
+#include "mlbf_updater.hpp"
+
+using namespace std;
+
+MLBFUpdater::MLBFUpdater(vector<string> _revoked, vector<string> _stay, const MLBFPlan& plan, int _threads,
+                         double _sideLimit, double _growthLimit)
+    : revoked(move(_revoked)), stay(move(_stay)), threads(_threads), sideLimit(_sideLimit), growthLimit(_growthLimit) {
+    sort(revoked.begin(), revoked.end());
+    filter.reset(new MLBFilter(revoked, stay, plan, threads));
+}
+
+bool MLBFUpdater::contains(const string& key) const {
+    if (!pending.empty() && pending.count(key)) {
+        return true;
+    }
+    if (!revokedSide.empty() && revokedSide.count(key)) {
+        return true;
+    }
+    if (!staySide.empty() && staySide.count(key)) {
+        return false;
+    }
+    return filter->contains(key);
+}
+
+void MLBFUpdater::revoke(const string& key) {
+    if (added.count(key) || binary_search(revoked.begin(), revoked.end(), key)) {
+        return;
+    }
+    staySide.erase(key);
+    added.insert(key);
+    pending.insert(key);
+}
+
+bool MLBFUpdater::foldKey(const string& key, size_t side, bool& changed) {
+    // level i is an R level for even i. the key is added to every level of its side it reaches
+    // until a level of the other side stops it, which answers its side
+    size_t levels = filter->numLevels();
+    for (size_t i = 0; i < levels; i++) {
+        if (filter->level(i).lookup(key)) {
+            continue;
+        }
+        if (i % 2 != side) {
+            return true;
+        }
+        filter->addToLevel(i, key);
+        changed = true;
+        if (i == 0) {
+            folded++;
+        }
+    }
+    // passed every level, an odd number of them answers R
+    return levels % 2 != side;
+}
+
+size_t MLBFUpdater::fold() {
+    // a fuse level is solved anew when a key is added, its false positives may then miss and
+    // answers change all over the cascade. its keys wait in the side set for recascade()
+    for (size_t i = 0; i < filter->numLevels(); i++) {
+        if (filter->levelKind(i) == BINARY_FUSE) {
+            size_t moved = pending.size();
+            revokedSide.insert(pending.begin(), pending.end());
+            pending.clear();
+            return moved;
+        }
+    }
+
+    bool changed = false;
+    for (const string& key : pending) {
+        if (!foldKey(key, 0, changed)) {
+            revokedSide.insert(key);
+        }
+    }
+    pending.clear();
+    if (!changed) {
+        return 0;
+    }
+
+    // R levels only gained bits, so R keys keep their answers, but S keys may now pass an R
+    // level they stopped at. they are folded into the S levels in turn, and the R keys those
+    // bits now let through go to the side set.
+    size_t conflicts = 0;
+    changed = false;
+    for (const string& key : stay) {
+        if (filter->contains(key) && !added.count(key) && !staySide.count(key)) {
+            if (!foldKey(key, 1, changed)) {
+                staySide.insert(key);
+                conflicts++;
+            }
+        }
+    }
+    if (!changed) {
+        return conflicts;
+    }
+    auto check = [&](const string& key) {
+        if (!filter->contains(key) && !revokedSide.count(key)) {
+            revokedSide.insert(key);
+            conflicts++;
+        }
+    };
+    for (const string& key : revoked) {
+        check(key);
+    }
+    for (const string& key : added) {
+        check(key);
+    }
+    return conflicts;
+}
+
+bool MLBFUpdater::needsRecascade() const {
+    double side = pending.size() + revokedSide.size() + staySide.size();
+    if (side > sideLimit * revoked.size()) {
+        return true;
+    }
+    const MLBFPlan& layout = filter->layout();
+    return !layout.levels.empty() && folded > growthLimit * layout.levels[0].capacity;
+}
+
+void MLBFUpdater::recascade() {
+    MLBFPlan plan = filter->layout();
+    revoked.insert(revoked.end(), added.begin(), added.end());
+    sort(revoked.begin(), revoked.end());
+    stay.erase(remove_if(stay.begin(), stay.end(), [&](const string& key) {
+        return added.count(key) != 0;
+    }), stay.end());
+    filter.reset(new MLBFilter(revoked, stay, plan, threads, 1, 0, 0, filter->hashFamily()));
+    added.clear();
+    pending.clear();
+    revokedSide.clear();
+    staySide.clear();
+    folded = 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "mlbf.hpp"
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+using namespace std;
+
+// Keeps an MLBF answering exactly while keys are revoked after its build.
+//
+// revoke() makes a key queryable at once through a small exact set of pending keys. fold()
+// moves the pending keys into the cascade: a key is added to every R level its path reaches
+// until an S level stops it. The new bits can make non-revoked keys pass an R level they used
+// to stop at, so fold() re-checks S and folds those keys into the S levels the same way, then
+// re-checks R once. Keys still answered wrong, or passing the last level with the wrong parity,
+// are kept in exact side sets. Once the side sets or the keys folded into level 1 pass their
+// limits, needsRecascade() asks for recascade(), a full build from the current keys.
+// A cascade with BINARY_FUSE levels does not gain bits monotonically, fold() keeps its pending
+// keys in the revoked side set instead.
+class MLBFUpdater {
+    private:
+        unique_ptr<MLBFilter> filter;
+        vector<string> revoked;         // sorted, revoke() looks keys up in it
+        vector<string> stay;            // still holds the keys revoked since the last build
+        int threads;
+        double sideLimit;               // side sets and pending keys, as a fraction of R
+        double growthLimit;             // keys folded into level 1, as a fraction of its capacity
+
+        unordered_set<string> added;    // revoked since the last build, pending or folded
+        unordered_set<string> pending;  // revoked since the last fold
+        unordered_set<string> revokedSide;
+        unordered_set<string> staySide;
+        size_t folded = 0;              // keys folded into level 1 since the last build
+
+        // adds key to the levels of its side (0 for R, 1 for S) on its path, sets changed if a
+        // bit was added. returns whether the key is now answered right.
+        bool foldKey(const string& key, size_t side, bool& changed);
+
+    public:
+        // builds the filter from plan, see MLBFilter. the updater keeps the keys.
+        MLBFUpdater(vector<string> _revoked, vector<string> _stay, const MLBFPlan& plan, int _threads = 1,
+                    double _sideLimit = 0.01, double _growthLimit = 0.1);
+
+        // contains: false means in S, true means in R
+        bool contains(const string& key) const;
+
+        // answered as revoked from the next query on, key may be in S or new. whether it is
+        // already revoked is decided by the keys, the filter answers a new key arbitrarily
+        void revoke(const string& key);
+
+        // adds the pending keys to the levels and re-checks the keys. returns the number of keys
+        // that moved to a side set.
+        size_t fold();
+
+        bool needsRecascade() const;
+
+        // builds the filter again from all revoked and non-revoked keys, with the layout of the
+        // current filter as plan, and clears the side sets
+        void recascade();
+
+        const MLBFilter& current() const {
+            return *filter;
+        }
+
+        size_t pendingSize() const {
+            return pending.size();
+        }
+
+        size_t sideSize() const {
+            return revokedSide.size() + staySide.size();
+        }
+};
@@ -0,0 +1,131 @@
+#include <cmath>
+#include <algorithm>
+#include "planner.hpp"
+
+using namespace std;
+
+const size_t MLBFPlanner::MAX_LEVELS;
+
+double MLBFPlanner::bits(FilterKind kind, double fpRate, double capacity, uint32_t k) {
+    if (kind == BINARY_FUSE) {
+        size_t slots = binary_fuse_filter::slots(llround(capacity));
+        return binary_fuse_filter::words(slots, binary_fuse_filter::fingerprint_bits(fpRate)) * 64.0;
+    }
+    double cells = -(k * capacity / log1p(-pow(fpRate, 1.0 / k)));
+    if (kind == BLOCKED_BLOOM) {
+        // whole blocks, and a few percent for the uneven block loads
+        cells = ceil(cells * 1.05 / blocked_bloom_filter::block_bits) * blocked_bloom_filter::block_bits;
+    }
+    return max(1.0, ceil(cells));
+}
+
+double MLBFPlanner::probes(FilterKind kind, uint32_t k, double fpRate, double members, double nonMembers) {
+    if (kind == BLOCKED_BLOOM) {
+        return members + nonMembers;
+    }
+    if (kind == BINARY_FUSE) {
+        // one slot in each of three consecutive segments
+        return (members + nonMembers) * 3;
+    }
+    if (kind == EXACT_SET) {
+        // a binary search over the fingerprints of the members, eight to a cache line
+        return (members + nonMembers) * max(1.0, log2(max(1.0, members / 8)) + 1);
+    }
+    // a non-member stops at the first clear bit, each bit is set with probability q
+    double q = pow(fpRate, 1.0 / k);
+    double miss = q == 1 ? k : (1 - pow(q, k)) / (1 - q);
+    return members * k + nonMembers * miss;
+}
+
+MLBFPlan MLBFPlanner::evaluate(size_t r, size_t s, FilterKind kind, double firstFpRate, double baseFpRate, uint32_t kCap) {
+    MLBFPlan plan;
+    // keys of R and S that reach the current level
+    double rIn = r, sIn = s;
+    double reached = 0, probed = 0;
+    for (size_t level = 1; level <= MAX_LEVELS; level++) {
+        double fpRate = level == 1 ? firstFpRate : baseFpRate;
+        bool odd = level % 2 == 1;
+        double members = odd ? rIn : sIn;
+        double nonMembers = odd ? sIn : rIn;
+
+        MLBFLevelPlan lp;
+        lp.kind = kind;
+        lp.fpRate = fpRate;
+        lp.capacity = max<uint64_t>(1, llround(members));
+        lp.k = 1;
+        lp.bits = bits(kind, fpRate, lp.capacity, 1);
+        for (uint32_t k = 2; k <= kCap; k++) {
+            double b = bits(kind, fpRate, lp.capacity, k);
+            if (b < lp.bits) {
+                lp.k = k;
+                lp.bits = b;
+            }
+        }
+        if (kind == BINARY_FUSE) {
+            // whole fingerprint bits, the level passes 2^-k of its non-members
+            lp.k = binary_fuse_filter::fingerprint_bits(fpRate);
+            fpRate = ldexp(1.0, -(int) lp.k);
+            lp.fpRate = fpRate;
+        }
+        plan.levels.push_back(lp);
+        plan.bits += lp.bits;
+        reached += members + nonMembers;
+        probed += probes(kind, lp.k, fpRate, members, nonMembers);
+
+        double passed = nonMembers * fpRate;
+        if (passed < 0.5) {
+            plan.expectedDepth = reached / (r + s);
+            plan.expectedProbes = probed / (r + s);
+            return plan;
+        }
+        (odd ? sIn : rIn) = passed;
+    }
+    return MLBFPlan();
+}
+
+MLBFPlan MLBFPlanner::plan(size_t r, size_t s, FilterKind kind, double maxBits, double maxProbes) {
+    vector<MLBFPlan> candidates;
+    uint32_t maxK = kind == BLOCKED_BLOOM ? blocked_bloom_filter::max_k : kind == BINARY_FUSE ? 1 : 8;
+    for (int i = 0; i <= 48; i++) {
+        double first = pow(10.0, -6 + i * 6.0 / 48) * 0.5;    // 5e-7 .. 0.5
+        for (int j = 0; j <= 40; j++) {
+            double base = 0.01 + j * (0.9 - 0.01) / 40;
+            for (uint32_t kCap = 1; kCap <= maxK; kCap++) {
+                MLBFPlan p = evaluate(r, s, kind, first, base, kCap);
+                if (!p.levels.empty()) {
+                    candidates.push_back(p);
+                }
+            }
+        }
+    }
+    if (candidates.empty()) {
+        return MLBFPlan();
+    }
+
+    // cost orders by the objective, feasible plans first
+    auto cost = [&](const MLBFPlan& p) {
+        if (maxProbes > 0) {
+            return p.expectedProbes <= maxProbes ? make_pair(0.0, p.bits) : make_pair(1.0, p.expectedProbes);
+        }
+        if (maxBits > 0) {
+            return p.bits <= maxBits ? make_pair(0.0, p.expectedProbes) : make_pair(1.0, p.bits);
+        }
+        return make_pair(0.0, p.bits);
+    };
+    const MLBFPlan* best = &candidates[0];
+    for (const MLBFPlan& p : candidates) {
+        if (cost(p) < cost(*best)) {
+            best = &p;
+        }
+    }
+    if (maxProbes > 0 || maxBits > 0) {
+        return *best;
+    }
+    double limit = best->bits * 1.01;
+    for (const MLBFPlan& p : candidates) {
+        if (p.bits <= limit && p.expectedProbes < best->expectedProbes) {
+            best = &p;
+        }
+    }
+    return *best;
+}
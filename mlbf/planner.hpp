@@ -0,0 +1,38 @@
+#pragma once
+
+#include "mlbf.hpp"
+
+using namespace std;
+
+// Chooses the fp rate and hash count of every MLBF level for a key set of |R| revoked and
+// |S| non-revoked keys. The cascade is modelled in expectation: a level inserts the keys of
+// one side that are still in play and passes fpRate of the other side on to the next level.
+// A level with n keys, fp rate f and k hash functions takes -k n / ln(1 - f^(1/k)) bits.
+//
+// A basic level costs a member k probes and a non-member 1 + q + ... + q^(k-1) probes with
+// q = f^(1/k), every probe is a cache line. A blocked level costs one cache line per key.
+// A BINARY_FUSE level costs three probes per key and rounds f down to 2^-k for k fingerprint
+// bits, with about 1.13 k bits per key on large levels and more on small ones.
+// The search covers the fp rate of level 1, one fp rate for the levels after it and a cap on
+// the hash count; every level takes the k below the cap that needs the fewest bits.
+class MLBFPlanner {
+    public:
+        // the plan with the fewest bits whose expected probes stay within maxProbes, or, with
+        // maxBits set instead, the plan with the fewest expected probes within maxBits.
+        // 0 disables a target. without a target the plan with the fewest probes among those
+        // within 1% of the smallest size is returned. an unreachable target returns the plan
+        // that comes closest to it.
+        static MLBFPlan plan(size_t r, size_t s, FilterKind kind = BASIC_BLOOM, double maxBits = 0, double maxProbes = 0);
+
+        // the expected layout of a cascade with the given rates, kCap bounds the hash count.
+        // returns a plan without levels if the cascade does not end within MAX_LEVELS levels.
+        static MLBFPlan evaluate(size_t r, size_t s, FilterKind kind, double firstFpRate, double baseFpRate, uint32_t kCap);
+
+        // expected cache lines touched at one level by members and nonMembers keys
+        static double probes(FilterKind kind, uint32_t k, double fpRate, double members, double nonMembers);
+
+        // bits of a level with capacity keys and k hash functions
+        static double bits(FilterKind kind, double fpRate, double capacity, uint32_t k);
+
+        static const size_t MAX_LEVELS = 64;
+};
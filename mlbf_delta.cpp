@@ -0,0 +1,55 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include "mlbf/frozen_mlbf.hpp"
+
+using namespace std;
+
+// computes and applies deltas between frozen MLBF files written by FrozenMLBFilter::save
+//   mlbf_delta diff <old filter> <new filter> <delta>
+//   mlbf_delta apply <filter> <delta> [<output filter>]
+
+static vector<uint8_t> readFile(const string& path) {
+  ifstream in(path, ios::binary);
+  if (!in.is_open()) {
+    throw runtime_error("cannot open " + path);
+  }
+  return vector<uint8_t>(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+static void writeFile(const string& path, const vector<uint8_t>& data) {
+  ofstream out(path, ios::binary);
+  out.write((const char*) data.data(), data.size());
+  if (!out) {
+    throw runtime_error("cannot write " + path);
+  }
+}
+
+int main(int argc, char **argv) {
+  string cmd = argc > 1 ? argv[1] : "";
+  if (!((cmd == "diff" && argc == 5) || (cmd == "apply" && (argc == 4 || argc == 5)))) {
+    cout << "usage: " << argv[0] << " diff <old filter> <new filter> <delta>\n"
+         << "       " << argv[0] << " apply <filter> <delta> [<output filter>]\n";
+    return -1;
+  }
+
+  try {
+    if (cmd == "diff") {
+      FrozenMLBFilter from(argv[2]);
+      FrozenMLBFilter to(argv[3]);
+      vector<uint8_t> delta = FrozenMLBFilter::delta(from, to);
+      writeFile(argv[4], delta);
+      cout << "delta " << delta.size() << " bytes, new filter " << to.bytesize() << " bytes\n";
+    } else {
+      FrozenMLBFilter filter(argv[2]);
+      filter.applyDelta(readFile(argv[3]));
+      // the mapping was released by applyDelta, the input may be overwritten
+      filter.save(argc == 5 ? argv[4] : argv[2]);
+    }
+  } catch (exception& e) {
+    cout << "ERROR: " << e.what() << "\n";
+    return -1;
+  }
+  return 0;
+}
@@ -1,4 +1,4 @@
-#pragma "once"
+#pragma once
 
 #include <vector>
 #include <iostream>
@@ -10,7 +10,10 @@
 #include <set>
 #include <algorithm>
 #include <cassert>
+#include <memory>
+#include <thread>
 #include "common.h"
+#include "persistence.h"
 
 #ifdef P4_CONCURY
 #include "p4/hash.h"
@@ -53,11 +56,15 @@ public:
         kvs[i].second = _values[i];
     } 
     
-    resetBuildState();
-    
     build();
   }
   
+  ~ControlPlaneOthello() {
+    waitCheckpoint();
+    if (logFile) fclose(logFile);
+    free(filled);
+  }
+  
   //****************************************
   //*************DATA Plane
   //****************************************
@@ -70,6 +77,14 @@ private:
   Hasher32<keyType> Ha; //<! hash function Ha
   Hasher32<keyType> Hb; //<! hash function Hb
   
+  /*! optional fingerprint array. Like mem, fpGet(ha) ^ fpGet(hb) equals the fingerprint of every key,
+   so a key whose fingerprint does not match is surely not a member. fpBits = 0 means disabled.
+   Slots are packed at fpBits bits each.
+   */
+  vector<uint64_t> fpMem;
+  uint8_t fpBits = 0;
+  Hasher32<keyType> Hc; //<! hash function for fingerprints
+  
   //inline int getMemSize() {
   //  if (valueLength) return (hashSizeReserve + 1) * 3 / 4;
   //  else return hashSizeReserve;
@@ -142,6 +157,34 @@ public:
     return Hb;
   }
   
+  inline uint32_t fingerprintOf(const keyType &k) const {
+    return Hc(k) >> (32 - fpBits);
+  }
+  
+  inline uint32_t fpGet(uint32_t index) const {
+    uint64_t bit = (uint64_t) index * fpBits;
+    uint32_t word = bit >> 6, offset = bit & 63;
+    uint64_t v = fpMem[word] >> offset;
+    if (offset + fpBits > 64) v |= fpMem[word + 1] << (64 - offset);
+    return v & ((1ULL << fpBits) - 1);
+  }
+  
+  inline void fpSet(uint32_t index, uint32_t fp) {
+    uint64_t bit = (uint64_t) index * fpBits;
+    uint32_t word = bit >> 6, offset = bit & 63;
+    uint64_t mask = (1ULL << fpBits) - 1;
+    fp &= mask;
+    fpMem[word] = (fpMem[word] & ~(mask << offset)) | ((uint64_t) fp << offset);
+    if (offset + fpBits > 64) {
+      uint32_t spill = 64 - offset;
+      fpMem[word + 1] = (fpMem[word + 1] & ~(mask >> spill)) | ((uint64_t) fp >> spill);
+    }
+  }
+  
+  inline int getFingerprintMemSize() const {
+    return fpBits ? ((uint64_t) hashSizeReserve * fpBits + 63) / 64 + 1 : 0;
+  }
+  
   /*!
    \brief returns a 64-bit integer query value for a key.
    */
@@ -215,6 +258,7 @@ private:
       ma = nextMa;
       mb = nextMb;
       mem.resize(getMemSize());
+      fpMem.resize(getFingerprintMemSize());
       free(filled);
       filled = (bool*) malloc(getFilledSize());
       indMem.resize(hashSizeReserve);
@@ -234,6 +278,9 @@ private:
       memSet(i, randVal(i));
       indMem[i] = rand();
     }
+    for (uint64_t &w : fpMem) {
+      w = ((uint64_t) rand() << 32) ^ rand();
+    }
     // _ind needn't to be initialized
     memset(filled, 0, getFilledSize());
     fill(keyIndicesOfThisNode.begin(), keyIndicesOfThisNode.end(), -1);
@@ -288,77 +335,150 @@ private:
   //! include all the old keys and the newly inserted key
   //! Warning: this method won't change the node value and the filled vector
   void addEdge(int key, uint32_t ha, uint32_t hb) {
+    linkEdge(key, ha, hb);
+    disj.merge(ha, hb);
+  }
+  
+  //! put a key into the key lists of both of its nodes
+  void linkEdge(int key, uint32_t ha, uint32_t hb) {
     nextKeyOfThisKeyAtPartA[key] = keyIndicesOfThisNode[ha];
     keyIndicesOfThisNode[ha] = key;
     nextKeyOfThisKeyAtPartB[key] = keyIndicesOfThisNode[hb];
     keyIndicesOfThisNode[hb] = key;
-    disj.merge(ha, hb);
   }
   
   //! test if this hash pair is acyclic, and build:
   //! the connected forest and the disjoint set of connected relation
   //! the disjoint set will be only useful to determine the root of a connected component
   //!
+  //! The keys are hashed once into a flat edge array, which is then radix-partitioned by node range:
+  //! partition p owns a 1/P slice of arrayA and the same slice of arrayB. Edges with both ends in one
+  //! partition go through the union-find first, one partition at a time, so the sets they touch stay
+  //! cache resident (every set built in this phase lies inside one partition). The remaining
+  //! cross-partition edges follow in (A slice, B slice) order, which keeps the A side local.
+  //! Acyclicity does not depend on the edge order. The per-node key lists are linked afterwards in key
+  //! order, so the per-key arrays are written sequentially.
+  //!
   //! Assume: all build related memory are cleared
-  //! Side effect: the disjoint set and the connected forest are properly set
+  //! Side effect: the disjoint set and the connected forest are properly set, edges holds the ends of every key
   bool testHash() {
-    uint32_t ha, hb;
-//    cout << "********\ntesting hash" << endl;
-    for (int i = 0; i < keyCnt; i++) {
-      getIndexAB(kvs[i].first, ha, hb);
-      
-//      cout << i << "th key: " << keys[i] << ", ha: " << ha << ", hb: " << hb << endl;
-      
-      if (disj.sameSet(ha, hb)) {  // if two indices are in the same disjoint set, means the corresponding key will incur circle.
-        //printf("Conflict key %d: %llx\n", i, *(unsigned long long*) &(keys[i]));
-        return false;
+    edges.resize(keyCnt);
+    for (uint32_t i = 0; i < keyCnt; i++) {
+      getIndexAB(kvs[i].first, edges[i].first, edges[i].second);
+    }
+    
+    uint32_t lgMa = __builtin_ctz(ma), lgMb = __builtin_ctz(mb);
+    uint32_t lgP = min<uint32_t>(lgMa > PARTITION_NODE_BITS ? lgMa - PARTITION_NODE_BITS : 0, uint32_t(MAX_PARTITION_BITS));
+    if (lgP == 0) {
+      for (uint32_t i = 0; i < keyCnt; i++) {
+        if (disj.sameSet(edges[i].first, edges[i].second)) return false;
+        addEdge(i, edges[i].first, edges[i].second);
       }
-      addEdge(i, ha, hb);
+      return true;
+    }
+    
+    // counting sort of the edges by bucket (A slice, B slice)
+    uint32_t shiftA = lgMa - lgP, shiftB = lgMb - lgP;
+    uint32_t P = 1U << lgP;
+    vector<uint32_t> bucketStart(P * P + 1, 0);
+    for (uint32_t i = 0; i < keyCnt; i++) {
+      bucketStart[edgeBucket(edges[i], shiftA, shiftB, lgP) + 1]++;
+    }
+    for (uint32_t b = 0; b < P * P; b++) {
+      bucketStart[b + 1] += bucketStart[b];
+    }
+    vector<pair<uint32_t, uint32_t>> sorted(keyCnt);
+    {
+      vector<uint32_t> pos(bucketStart.begin(), bucketStart.end() - 1);
+      for (uint32_t i = 0; i < keyCnt; i++) {
+        sorted[pos[edgeBucket(edges[i], shiftA, shiftB, lgP)]++] = edges[i];
+      }
+    }
+    
+    // phase 1: edges inside a partition, partition by partition
+    for (uint32_t p = 0; p < P; p++) {
+      uint32_t b = p * P + p;
+      for (uint32_t j = bucketStart[b]; j < bucketStart[b + 1]; j++) {
+        if (!tryMerge(sorted[j])) return false;
+      }
+    }
+    // phase 2: cross-partition edges
+    for (uint32_t b = 0; b < P * P; b++) {
+      if (b / P == b % P) continue;
+      for (uint32_t j = bucketStart[b]; j < bucketStart[b + 1]; j++) {
+        if (!tryMerge(sorted[j])) return false;
+      }
+    }
+    
+    for (uint32_t i = 0; i < keyCnt; i++) {
+      linkEdge(i, edges[i].first, edges[i].second);
+    }
+    return true;
+  }
+  
+  const static uint32_t PARTITION_NODE_BITS = 15; //!< nodes per side of a build partition (log2), keeps a partition in L2
+  const static uint32_t MAX_PARTITION_BITS = 8;   //!< at most 2^8 partitions, i.e. 2^16 buckets
+  
+  vector<pair<uint32_t, uint32_t>> edges; //!< (ha, hb) of every key, only kept during a build
+  vector<pair<uint32_t, int32_t>> bfsQueue; //!< (node, key it was reached by), reused by fillTreeBFS
+  
+  inline uint32_t edgeBucket(const pair<uint32_t, uint32_t> &e, uint32_t shiftA, uint32_t shiftB, uint32_t lgP) const {
+    return ((e.first >> shiftA) << lgP) | ((e.second - ma) >> shiftB);
+  }
+  
+  //! merge the ends of an edge unless it closes a circle
+  inline bool tryMerge(const pair<uint32_t, uint32_t> &e) {
+    if (disj.sameSet(e.first, e.second)) {  // if two indices are in the same disjoint set, means the corresponding key will incur circle.
+      return false;
     }
+    disj.merge(e.first, e.second);
     return true;
   }
   
+  //! ends of the edge of a key, from the edge array during a build
+  inline void getEdge(int32_t key, uint32_t &ha, uint32_t &hb) {
+    if (!edges.empty()) {
+      ha = edges[key].first;
+      hb = edges[key].second;
+    } else {
+      getIndexAB(kvs[key].first, ha, hb);
+    }
+  }
+  
   //! Fill a connected tree from the root.
   //! the value of root is set, and set all its children according to root values
   //! Assume: values are present, and the connected forest are properly set
   //! Side effect: all node in this tree is set and if updateToFilled, the filled vector will record filled values
-  template<bool updateToFilled, bool fillValue, bool fillIndex>
-  void fillTreeBFS(int root) {
+  //! fingerprints are filled together with values unless asked otherwise
+  template<bool updateToFilled, bool fillValue, bool fillIndex, bool fillFingerprint = fillValue>
+  void fillTreeBFS(int root, vector<bool> *reached = nullptr) {
     if (updateToFilled) setFilled(root);
+    if (reached) (*reached)[root] = true;
     
-    list<uint32_t> Q;
-    Q.clear();
-    Q.push_back(root);
+    // the forest is acyclic, so the only filled neighbor of a node is the one it was reached from
+    bfsQueue.clear();
+    bfsQueue.push_back(make_pair((uint32_t) root, -1));
     
-    std::set<uint32_t> visited;
-    visited.insert(root);
-    
-    while (!Q.empty()) {
-      uint32_t nodeid = (*Q.begin());
-      Q.pop_front();
-      
-      // // find all the opposite side node to be filled
+    for (size_t head = 0; head < bfsQueue.size(); ++head) {
+      uint32_t nodeid = bfsQueue[head].first;
+      int32_t reachedBy = bfsQueue[head].second;
       
       // search all the edges of this node, to fill and enqueue the opposite side, and record the fill
       vector<int32_t> *nextKeyOfThisKey;
       nextKeyOfThisKey = (nodeid < ma) ? &nextKeyOfThisKeyAtPartA : &nextKeyOfThisKeyAtPartB;
       
-      for (int32_t currKeyIndex = keyIndicesOfThisNode[nodeid]; currKeyIndex >= 0; currKeyIndex = nextKeyOfThisKey->at(currKeyIndex)) {
-        uint32_t ha, hb;
-        getIndexAB(kvs[currKeyIndex].first, ha, hb);
-        
-        // now the opposite side node needs to be filled
-        // fill and enqueue all next element of
-        
-        // ha xor hb must have been filled, find the opposite side
-        bool aFilled = visited.find(ha) != visited.end();
-        int toBeFilled = aFilled ? hb : ha;
-        int hasBeenFilled = aFilled ? ha : hb;
-        
-        if (visited.find(toBeFilled) != visited.end()) {
+      for (int32_t currKeyIndex = keyIndicesOfThisNode[nodeid]; currKeyIndex >= 0; currKeyIndex = (*nextKeyOfThisKey)[currKeyIndex]) {
+        if (currKeyIndex == reachedBy) {
           continue;
         }
         
+        uint32_t ha, hb;
+        getEdge(currKeyIndex, ha, hb);
+        
+        // nodeid has been filled, the opposite side needs to be filled
+        int toBeFilled = (nodeid == ha) ? hb : ha;
+        int hasBeenFilled = nodeid;
+        
         if (fillValue) {
           valueType &value = kvs[currKeyIndex].second;
           valueType valueToFill = value ^ memGet(hasBeenFilled);
@@ -370,25 +490,107 @@ private:
           indMem[toBeFilled] = indexToFill;
         }
         
-        Q.push_back(toBeFilled);
+        if (fillFingerprint && fpBits) {
+          fpSet(toBeFilled, fingerprintOf(kvs[currKeyIndex].first) ^ fpGet(hasBeenFilled));
+        }
+        
+        bfsQueue.push_back(make_pair((uint32_t) toBeFilled, currKeyIndex));
         if (updateToFilled) setFilled(toBeFilled);
-        visited.insert(toBeFilled);
+        if (reached) (*reached)[toBeFilled] = true;
       }
     }
   }
   
   //! Fill *Othello* so that the query returns values as defined
   //!
+  //! The edges are radix-sorted by node into an adjacency array that carries the opposite node and the
+  //! value, so the edges of a node are read contiguously without chasing the per-key linked lists or
+  //! hashing keys again. All trees are then filled together, level by level from their roots: each
+  //! frontier is radix-partitioned by node range, so the adjacency reads and the writes to
+  //! mem/indMem/filled of a level proceed one cache-sized partition at a time.
+  //!
   //! Assume: edges and disjoint set are properly set up, filled is clear.
   //! Side effect: filled vector and all values are properly set
   void fillValue() {
-    for (int i = 0; i < ma + mb; i++)
+    uint32_t m = ma + mb;
+    vector<uint32_t> adjStart(m + 1, 0);
+    for (uint32_t i = 0; i < keyCnt; i++) {
+      adjStart[edges[i].first + 1]++;
+      adjStart[edges[i].second + 1]++;
+    }
+    for (uint32_t i = 0; i < m; i++) {
+      adjStart[i + 1] += adjStart[i];
+    }
+    vector<HalfEdge> adj(2 * keyCnt);
+    {
+      vector<uint32_t> pos(adjStart.begin(), adjStart.end() - 1);
+      for (uint32_t i = 0; i < keyCnt; i++) {
+        HalfEdge e = { edges[i].second, (int32_t) i, kvs[i].second };
+        adj[pos[edges[i].first]++] = e;
+        e.to = edges[i].first;
+        adj[pos[edges[i].second]++] = e;
+      }
+    }
+    
+    // the roots, in node order
+    vector<NodeFill> frontier, next;
+    for (uint32_t i = 0; i < m; i++)
       if (disj.isRoot(i)) {  // we can only fix one end's value in a cc of keys, then fix the roots'
-        memSet(i, randVal());
-        fillTreeBFS<true, true, true>(i);
+        NodeFill root = { i, -1, (uint32_t) indMem[i], fpBits ? fpGet(i) : 0, randVal() };
+        frontier.push_back(root);
       }
+    
+    uint32_t shift = PARTITION_NODE_BITS;
+    vector<uint32_t> partStart((m >> shift) + 2);
+    while (!frontier.empty()) {
+      next.clear();
+      for (const NodeFill &from : frontier) {
+        memSet(from.node, from.value);
+        indMem[from.node] = from.index;
+        if (fpBits) fpSet(from.node, from.fp);
+        setFilled(from.node);
+        
+        // the forest is acyclic, so the only filled neighbor of a node is the one it was reached from
+        for (uint32_t j = adjStart[from.node]; j < adjStart[from.node + 1]; ++j) {
+          const HalfEdge &e = adj[j];
+          if (e.key == from.reachedBy) continue;
+          
+          NodeFill to = { e.to, e.key, e.key ^ from.index, from.fp, (valueType) (e.value ^ from.value) };
+          if (fpBits) to.fp ^= fingerprintOf(kvs[e.key].first);
+          next.push_back(to);
+        }
+      }
+      
+      // counting sort of the next level by node partition
+      fill(partStart.begin(), partStart.end(), 0);
+      for (const NodeFill &f : next) {
+        partStart[(f.node >> shift) + 1]++;
+      }
+      for (uint32_t p = 0; p + 1 < partStart.size(); p++) {
+        partStart[p + 1] += partStart[p];
+      }
+      frontier.resize(next.size());
+      for (const NodeFill &f : next) {
+        frontier[partStart[f.node >> shift]++] = f;
+      }
+    }
   }
   
+  struct HalfEdge {
+    uint32_t to;    //!< the opposite node
+    int32_t key;
+    valueType value;
+  };
+  
+  //! a node to fill, with the values derived from its parent
+  struct NodeFill {
+    uint32_t node;
+    int32_t reachedBy; //!< the key whose edge reached this node, -1 for a root
+    uint32_t index;
+    uint32_t fp;
+    valueType value;
+  };
+  
   //! Begin a new build
   //!
   //! Side effect: 1) discard all memory except keys and values. 2) build fail, or
@@ -424,6 +626,7 @@ private:
       }
       built = trybuild();
     } while ((!built) && (tryCount < MAX_REHASH));
+    vector<pair<uint32_t, uint32_t>>().swap(edges);
     
     //printf("%08x %08x\n", Ha.s, Hb.s);
     if (built) {
@@ -476,6 +679,12 @@ private:
   
 public:
   inline bool insert(pair<keyType, valueType> &&kv) {
+    if (logFile) {
+      persistWrite(logFile, (uint8_t) LOG_INSERT);
+      persistWrite(logFile, kv);
+      fflush(logFile);
+    }
+    
     resizeKey(keyCnt + 1);
     
     int lastIndex = keyCnt - 1;
@@ -505,6 +714,12 @@ public:
    \note remember to adjust the value[] array if necessary.
    */
   void eraseAt(uint32_t kid) {
+    if (logFile) {
+      persistWrite(logFile, (uint8_t) LOG_ERASE);
+      persistWrite(logFile, kid);
+      fflush(logFile);
+    }
+    
     uint32_t ha, hb;
     getIndexAB(kvs[kid].first, ha, hb);
     keyCnt--;
@@ -529,6 +744,12 @@ public:
       nextKeyOfThisKeyAtPartB[t] = nextKeyOfThisKeyAtPartB[nextKeyOfThisKeyAtPartB[t]];
     }
     
+    // the erased key splits its tree, give the hb side a fresh fingerprint so the key no longer verifies
+    if (fpBits) {
+      fpSet(hb, rand());
+      fillTreeBFS<false, false, false, true>(hb);
+    }
+    
     // move the last to fill the hole
     if (kid == keyCnt) return;
     kvs[kid] = kvs[keyCnt];
@@ -572,6 +793,13 @@ public:
   inline void updateValueAt(int index, valueType val) {
     if (index >= keyCnt) throw exception();
     
+    if (logFile) {
+      persistWrite(logFile, (uint8_t) LOG_UPDATE);
+      persistWrite(logFile, (uint32_t) index);
+      persistWrite(logFile, val);
+      fflush(logFile);
+    }
+    
     kvs[index].second = val;
   }
 
@@ -596,6 +824,35 @@ public:
     return (index < keyCnt && kvs[index].first == x);
   }
   
+  /*!
+   \brief maintain a fingerprint array of bits bits per slot, so that the data plane can reject keys
+   that were never inserted with false-accept rate 2^-bits, without the key list.
+   \param [in] bits 1..32, 0 disables fingerprints.
+   */
+  void enableFingerprint(uint8_t bits) {
+    assert(bits <= 32);
+    fpBits = bits;
+    fpMem.assign(getFingerprintMemSize(), 0);
+    if (!fpBits) return;
+    
+    Hc.setSeed(rand());
+    for (uint32_t i = 0; i < fpMem.size(); ++i) {
+      fpMem[i] = ((uint64_t) rand() << 32) ^ rand();
+    }
+    
+    // the forest is intact, so every tree can be refilled from any of its nodes
+    vector<bool> done(ma + mb);
+    for (uint32_t i = 0; i < keyCnt; ++i) {
+      uint32_t ha;
+      getIndexA(kvs[i].first, ha);
+      if (!done[ha]) fillTreeBFS<false, false, false, true>(ha, &done);
+    }
+  }
+  
+  inline uint8_t getFingerprintBits() const {
+    return fpBits;
+  }
+  
   inline void erase(keyType& x) {
     assert(isMember(x));
     
@@ -612,5 +869,242 @@ public:
     
     return true;
   }
+  //****************************************
+  //*********PERSISTENCE
+  //****************************************
+  /*
+   * A checkpoint stores the complete control plane state: hash seeds, mem, fingerprints, indMem, kvs and the
+   * forest linked lists, so that a restart is a sequential read with no rehash.
+   * Every insert/eraseAt/updateValueAt after the checkpoint is appended to a write-ahead log,
+   * which is replayed on restore. Log files are numbered: <logPath>.<seq>. Taking a checkpoint
+   * moves writers to the next log file, and the files before it are removed once the checkpoint
+   * is durable, so a crash at any point leaves a checkpoint plus the logs that follow it.
+   */
+private:
+  const static uint64_t CHECKPOINT_MAGIC = 0x3154504b4f485443ULL; //!< "CTHOKPT1"
+  
+  enum LogOp : uint8_t {
+    LOG_INSERT = 1, LOG_ERASE = 2, LOG_UPDATE = 3
+  };
+  
+  //! a copy of the persistent state, taken synchronously and written to disk in the background.
+  struct Snapshot {
+    uint32_t ma, mb, hashSizeReserve, keyCnt, keyCntReserve, sa, sb, sc;
+    uint8_t fpBits;
+    uint64_t nextLogSeq;
+    vector<valueType> mem;
+    vector<uint64_t> fpMem;
+    vector<uint32_t> indMem;
+    vector<pair<keyType, valueType>> kvs;
+    vector<int32_t> keyIndicesOfThisNode, nextKeyOfThisKeyAtPartA, nextKeyOfThisKeyAtPartB;
+    vector<uint8_t> filled;
+  };
+  
+  FILE *logFile = nullptr;
+  string logPath;
+  uint64_t logSeq = 0;
+  std::thread checkpointThread;
+  
+  struct RestoreTag {
+  };
+  
+  explicit ControlPlaneOthello(RestoreTag) {
+  }
+  
+  static string logName(const string &path, uint64_t seq) {
+    return path + "." + to_string(seq);
+  }
+  
+  static bool writeSnapshot(const Snapshot &snap, FILE *f) {
+    uint64_t magic = CHECKPOINT_MAGIC;
+    uint32_t l = L;
+    return persistWrite(f, magic) && persistWrite(f, l)     //
+        && persistWrite(f, snap.ma) && persistWrite(f, snap.mb) && persistWrite(f, snap.hashSizeReserve)     //
+        && persistWrite(f, snap.keyCnt) && persistWrite(f, snap.keyCntReserve)     //
+        && persistWrite(f, snap.sa) && persistWrite(f, snap.sb) && persistWrite(f, snap.nextLogSeq)     //
+        && persistWrite(f, snap.sc) && persistWrite(f, snap.fpBits) && persistWriteVector(f, snap.fpMem)     //
+        && persistWriteVector(f, snap.mem) && persistWriteVector(f, snap.indMem) && persistWriteVector(f, snap.kvs)     //
+        && persistWriteVector(f, snap.keyIndicesOfThisNode)     //
+        && persistWriteVector(f, snap.nextKeyOfThisKeyAtPartA) && persistWriteVector(f, snap.nextKeyOfThisKeyAtPartB)     //
+        && persistWriteVector(f, snap.filled) && persistWrite(f, magic);
+  }
+  
+  //! load a checkpoint into this instance. Returns the first log sequence number to replay.
+  bool readCheckpoint(FILE *f, uint64_t &nextLogSeq) {
+    uint64_t magic;
+    uint32_t l, sa, sb, sc;
+    vector<uint8_t> filledBytes;
+    if (!persistRead(f, magic) || magic != CHECKPOINT_MAGIC || !persistRead(f, l) || l != L) return false;
+    if (!(persistRead(f, ma) && persistRead(f, mb) && persistRead(f, hashSizeReserve)     //
+        && persistRead(f, keyCnt) && persistRead(f, keyCntReserve)     //
+        && persistRead(f, sa) && persistRead(f, sb) && persistRead(f, nextLogSeq)     //
+        && persistRead(f, sc) && persistRead(f, fpBits) && persistReadVector(f, fpMem)     //
+        && persistReadVector(f, mem) && persistReadVector(f, indMem) && persistReadVector(f, kvs)     //
+        && persistReadVector(f, keyIndicesOfThisNode)     //
+        && persistReadVector(f, nextKeyOfThisKeyAtPartA) && persistReadVector(f, nextKeyOfThisKeyAtPartB)     //
+        && persistReadVector(f, filledBytes) && persistRead(f, magic) && magic == CHECKPOINT_MAGIC)) {
+      return false;
+    }
+    
+    Ha.setSeed(sa);
+    Hb.setSeed(sb);
+    Hc.setSeed(sc);
+    kvs.resize(keyCntReserve);
+    nextKeyOfThisKeyAtPartA.resize(keyCntReserve, -1);
+    nextKeyOfThisKeyAtPartB.resize(keyCntReserve, -1);
+    disj.resize(hashSizeReserve);
+    free(filled);
+    filled = (bool*) malloc(getFilledSize());
+    for (uint32_t i = 0; i < hashSizeReserve; ++i)
+      filled[i] = filledBytes[i];
+    built = true;
+    return true;
+  }
+  
+  //! apply the records of one log file. A torn record at the tail (crash during append) is cut off.
+  //! Returns false if the log file does not exist.
+  bool replayLog(const string &name) {
+    FILE *f = fopen(name.c_str(), "rb");
+    if (!f) return false;
+    
+    long good = 0;
+    uint8_t op;
+    while (persistRead(f, op)) {
+      if (op == LOG_INSERT) {
+        pair<keyType, valueType> kv;
+        if (!persistRead(f, kv)) break;
+        insert(std::move(kv));
+      } else if (op == LOG_ERASE) {
+        uint32_t kid;
+        if (!persistRead(f, kid)) break;
+        eraseAt(kid);
+      } else if (op == LOG_UPDATE) {
+        uint32_t index;
+        valueType val;
+        if (!persistRead(f, index) || !persistRead(f, val)) break;
+        updateValueAt(index, val);
+      } else {
+        break;
+      }
+      good = ftell(f);
+    }
+    
+    fseek(f, 0, SEEK_END);
+    bool torn = ftell(f) != good;
+    fclose(f);
+    if (torn && truncate(name.c_str(), good) != 0) {
+      cout << "cannot cut torn log tail " << name << endl;
+    }
+    return true;
+  }
+  
+public:
+  /*!
+   \brief start appending every mutation to the write-ahead log <path>.<seq>.
+   \note records are flushed to the OS after each operation, call syncLog() to make them durable.
+   */
+  void attachLog(const string &path, uint64_t seq = 0) {
+    if (logFile) fclose(logFile);
+    logPath = path;
+    logSeq = seq;
+    logFile = fopen(logName(logPath, logSeq).c_str(), "ab");
+    if (!logFile) throw runtime_error("cannot open log " + logName(logPath, logSeq));
+  }
+  
+  //! fsync the write-ahead log.
+  bool syncLog() {
+    return logFile == nullptr || persistSync(logFile);
+  }
+  
+  /*!
+   \brief write a checkpoint of the current state to path.
+   \note the state is copied synchronously (sequential memcpy of the arrays) and the file is written by a
+   background thread, so writers can continue right after this call returns. The checkpoint replaces
+   path atomically once it is fully on disk. Only one checkpoint is in flight at a time.
+   */
+  void checkpoint(const string &path) {
+    waitCheckpoint();
+    
+    shared_ptr<Snapshot> snap(new Snapshot());
+    snap->ma = ma;
+    snap->mb = mb;
+    snap->hashSizeReserve = hashSizeReserve;
+    snap->keyCnt = keyCnt;
+    snap->keyCntReserve = keyCntReserve;
+    snap->sa = Ha.s;
+    snap->sb = Hb.s;
+    snap->sc = Hc.s;
+    snap->fpBits = fpBits;
+    snap->fpMem = fpMem;
+    snap->mem = mem;
+    snap->indMem = indMem;
+    snap->kvs.assign(kvs.begin(), kvs.begin() + keyCnt);
+    snap->keyIndicesOfThisNode = keyIndicesOfThisNode;
+    snap->nextKeyOfThisKeyAtPartA.assign(nextKeyOfThisKeyAtPartA.begin(), nextKeyOfThisKeyAtPartA.begin() + keyCnt);
+    snap->nextKeyOfThisKeyAtPartB.assign(nextKeyOfThisKeyAtPartB.begin(), nextKeyOfThisKeyAtPartB.begin() + keyCnt);
+    snap->filled.assign(filled, filled + hashSizeReserve);
+    
+    // everything after the snapshot goes to a new log file
+    bool retire = logFile != nullptr;
+    uint64_t retiredSeq = logSeq;
+    if (retire) {
+      persistSync(logFile);
+      attachLog(logPath, logSeq + 1);
+    }
+    snap->nextLogSeq = logSeq;
+    
+    string logBase = logPath;
+    checkpointThread = std::thread([snap, path, logBase, retire, retiredSeq]() {
+      string tmp = path + ".tmp";
+      FILE *f = fopen(tmp.c_str(), "wb");
+      if (!f || !writeSnapshot(*snap, f) || !persistSync(f)) {
+        cout << "checkpoint write failed: " << tmp << endl;
+        if (f) fclose(f);
+        return;
+      }
+      fclose(f);
+      if (rename(tmp.c_str(), path.c_str()) != 0) {
+        cout << "checkpoint rename failed: " << path << endl;
+        return;
+      }
+      // the checkpoint covers all older logs now
+      for (uint64_t seq = retiredSeq + 1; retire && seq-- > 0;) {
+        if (remove(logName(logBase, seq).c_str()) != 0) break;
+      }
+    });
+  }
+  
+  //! block until the background checkpoint writer (if any) has finished.
+  void waitCheckpoint() {
+    if (checkpointThread.joinable()) checkpointThread.join();
+  }
+  
+  /*!
+   \brief rebuild a control plane from a checkpoint and replay the log files that follow it.
+   \param [in] checkpointPath the file written by checkpoint()
+   \param [in] logPath the log base path passed to attachLog(). If not empty, logging continues
+   on the last replayed log file.
+   \retval a new instance, or nullptr if the checkpoint cannot be read.
+   */
+  static ControlPlaneOthello* restore(const string &checkpointPath, const string &logPath = "") {
+    FILE *f = fopen(checkpointPath.c_str(), "rb");
+    if (!f) return nullptr;
+    
+    ControlPlaneOthello *oth = new ControlPlaneOthello(RestoreTag());
+    uint64_t firstSeq;
+    bool ok = oth->readCheckpoint(f, firstSeq);
+    fclose(f);
+    if (!ok) {
+      delete oth;
+      return nullptr;
+    }
+    
+    if (!logPath.empty()) {
+      uint64_t seq = firstSeq;
+      while (oth->replayLog(logName(logPath, seq)))
+        seq++;
+      oth->attachLog(logPath, seq > firstSeq ? seq - 1 : seq);
+    }
+    return oth;
+  }
 };
-
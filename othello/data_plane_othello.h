@@ -60,7 +60,8 @@ public:
   }
   
   DataPlaneOthello(ControlPlaneOthello<keyType, valueType, valueLength>& control)
-      : ma(control.ma), mb(control.mb), hashSizeReserve(control.ma + control.mb), Ha(control.Ha), Hb(control.hashSizeReserve), mem(control.mem) {
+      : mem(control.mem), ma(control.ma), mb(control.mb), hashSizeReserve(control.ma + control.mb), Ha(control.Ha), Hb(control.Hb),     //
+        fpMem(control.fpMem), fpBits(control.fpBits), Hc(control.Hc) {
   }
     
   void updateFromControlPlane(ControlPlaneOthello<keyType, valueType, valueLength>& control) {
@@ -70,6 +71,9 @@ public:
     this->Ha = control.Ha;
     this->Hb = control.Hb;
     this->mem = control.mem;
+    this->fpMem = control.fpMem;
+    this->fpBits = control.fpBits;
+    this->Hc = control.Hc;
   }
   
   //****************************************
@@ -82,6 +86,9 @@ private:
   uint32_t hashSizeReserve = 0;
   Hasher32<keyType> Ha; //<! hash function Ha
   Hasher32<keyType> Hb; //<! hash function Hb
+  vector<uint64_t> fpMem; //!< fingerprint array packed at fpBits per slot, empty if the control plane has none
+  uint8_t fpBits = 0;
+  Hasher32<keyType> Hc; //<! hash function for fingerprints
   
   void inline get_hash_1(const keyType &k, uint32_t &ret1) const {
     ret1 = (Ha)(k) & (ma - 1);
@@ -135,11 +142,43 @@ public:
     return LMASK & (aa ^ bb);
   }
   
+  /*!
+   \brief query a key and verify its fingerprint.
+   \param [in] keyType &k key
+   \param [out] valueType &v the value, only meaningful when true is returned
+   \retval false if k is certainly not in the key set. Keys outside the set pass with probability 2^-fpBits.
+   \note requires fingerprints enabled on the control plane (ControlPlaneOthello::enableFingerprint).
+   */
+  inline bool queryMember(const keyType &k, valueType &v) const {
+    assert(fpBits);
+    uint32_t ha, hb;
+    v = query(k, ha, hb);
+    return (fpGet(ha) ^ fpGet(hb)) == (Hc(k) >> (32 - fpBits));
+  }
+  
+  inline uint32_t fpGet(uint32_t index) const {
+    uint64_t bit = (uint64_t) index * fpBits;
+    uint32_t word = bit >> 6, offset = bit & 63;
+    uint64_t v = fpMem[word] >> offset;
+    if (offset + fpBits > 64) v |= fpMem[word + 1] << (64 - offset);
+    return v & ((1ULL << fpBits) - 1);
+  }
+  
+  //! raw bytes of mem for packed 12-bit values. vector<bool> is never packed and has no data().
+  template<class T>
+  static const uint8_t* memBytes(const vector<T> &m) {
+    return (const uint8_t*) m.data();
+  }
+  
+  static const uint8_t* memBytes(const vector<bool> &m) {
+    return nullptr;
+  }
+  
   valueType inline memGet(int index) const {
     static_assert(valueLength == 0 || (valueLength == 12 && sizeof(valueType)==sizeof(uint16_t)), "");
     
     if (valueLength) {
-      uint16_t res = *(uint16_t*) ((uint8_t*) &mem[0] + index * 3 / 2);
+      uint16_t res = *(uint16_t*) (memBytes(mem) + index * 3 / 2);
       if (index & 1) res >>= 4;
       
       return res & 0x0FFF;
@@ -157,7 +196,7 @@ public:
   //****************************************
 public:
   uint64_t reportDataPlaneMemUsage() const {
-    uint64_t size = mem.size() * sizeof(valueType);
+    uint64_t size = mem.size() * sizeof(valueType) + fpMem.size() * sizeof(uint64_t);
     
     cout << "Ma: " << ma * sizeof(valueType) << ", Mb: " << mb * sizeof(valueType) << endl;
     
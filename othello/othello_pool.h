@@ -0,0 +1,341 @@
+#pragma once
+/*!
+ \file othello_pool.h
+ Describes *OthelloPool*: many small static Othello maps, one per issuer, sharing a single arena.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include "common.h"
+#include "hash.h"
+#include "disjointset.h"
+
+using namespace std;
+
+/*!
+ * \brief A pool of small Othello maps keyed by an issuer, e.g. one revocation map per issuing CA.
+ * query(issuer, k) looks up the issuer in a sorted directory of 64-bit issuer digests, confirms it by a 32-bit
+ * check hash, then evaluates mem[ha] ^ mem[hb] inside the issuer's region of one shared arena of uint64_t.
+ *
+ * Every member is static: setMember() rebuilds one issuer from its full key set and leaves the others
+ * untouched. A member is sized for its own keys (arrays down to 1 slot, L bits per slot, bit packed), and
+ * its hash seeds are derived from the issuer digest and a 16-bit seed index, so the fixed overhead of a
+ * member is its 8-byte digest, its 4-byte check hash and an 8-byte directory entry. Issuers whose digests
+ * collide get adjacent directory entries: the first is told apart by its check hash, the later ones are kept
+ * in a side table and compared in full.
+ * \note keys outside the build set of an issuer return an arbitrary value, as with Othello.
+ * \note valueType must be some kind of int with no more than 8 bytes' length.
+ */
+template<class issuerType, class keyType, class valueType, uint8_t valueLength = 0>
+class OthelloPool {
+  static_assert(sizeof(valueType) <= 8, "valueType must be no more than 8 bytes");
+  static_assert(sizeof(valueType) * 8 >= valueLength, "sizeof(valueType)*8 < valueLength");
+private:
+  //*******builtin values
+  const static int MAX_REHASH = 64; //!< seed indices tried at one array size before both arrays are doubled.
+  const static int MAX_GROW = 8;    //!< number of doublings before a member build fails.
+  const static uint32_t L = valueLength ? valueLength : (is_same<valueType, bool>::value ? 1 : sizeof(valueType) * 8); //!< the bit length of return value.
+  const static uint64_t LMASK = ((L == 64) ? (~0ULL) : ((1ULL << L) - 1));
+
+  //! directory entry of a member. Its digest and check hash are kept in the parallel arrays dirDigest and dirCheck.
+  struct Member {
+    uint32_t offset; //!< first word of the member in the arena
+    uint16_t seed;   //!< seed index, the hash seeds are derived from the issuer digest and this index
+    uint8_t lgMa;    //!< log2 of the length of arrayA
+    uint8_t lgMb;    //!< log2 of the length of arrayB
+  };
+
+  vector<uint64_t> dirDigest;   //!< sorted issuer digests, equal digests are adjacent
+  vector<uint32_t> dirCheck;    //!< check hash of the issuer of members[i], over the whole issuer
+  vector<Member> members;       //!< members[i] belongs to the issuer of digest dirDigest[i]
+  //! issuers of the members after the first of a digest shared by several, in directory order
+  unordered_map<uint64_t, vector<issuerType>> shared;
+  vector<uint64_t> arena;       //!< the arrays of all members
+  uint64_t garbage = 0;         //!< arena words no longer referenced by any member
+  Hasher32<issuerType> Hi1, Hi2; //!< directory hash functions
+
+public:
+  OthelloPool()
+      : Hi1(0x9e3779b9), Hi2(0x7f4a7c15) {
+  }
+
+  //****************************************
+  //*************DATA Plane
+  //****************************************
+private:
+  static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  inline uint64_t digestOf(const issuerType &issuer) const {
+    return ((uint64_t) Hi1(issuer) << 32) | Hi2(issuer);
+  }
+
+  //! Hasher32 reads a long string only in part, the check hash reads all of the issuer.
+  static inline uint32_t checkOf(const issuerType &issuer) {
+    return (uint32_t) mix64(hash<issuerType>()(issuer));
+  }
+
+  //! position of an issuer with this digest in the directory, -1 if absent.
+  inline int find(const issuerType &issuer, uint64_t digest) const {
+    int first = lower_bound(dirDigest.begin(), dirDigest.end(), digest) - dirDigest.begin();
+    if (first == (int) dirDigest.size() || dirDigest[first] != digest) return -1;
+    if (first + 1 < (int) dirDigest.size() && dirDigest[first + 1] == digest) {
+      const vector<issuerType> &later = shared.find(digest)->second;
+      for (size_t j = 0; j < later.size(); ++j) {
+        if (later[j] == issuer) return first + 1 + j;
+      }
+    }
+    return dirCheck[first] == checkOf(issuer) ? first : -1;
+  }
+
+  template<class T>
+  static inline size_t heapBytes(const T &) {
+    return 0;
+  }
+
+  //! a short string keeps its characters inside the object
+  static inline size_t heapBytes(const string &s) {
+    const char *data = s.data(), *object = (const char*) &s;
+    return data >= object && data < object + sizeof(s) ? 0 : s.capacity() + 1;
+  }
+
+  //! the two hash seeds of a member
+  static inline uint64_t seedsOf(uint64_t digest, uint16_t seed) {
+    return mix64(digest + (seed + 1) * 0x9e3779b97f4a7c15ULL);
+  }
+
+  static inline void getIndexAB(const keyType &k, uint64_t seeds, uint8_t lgMa, uint8_t lgMb, uint32_t &ha, uint32_t &hb) {
+    ha = Hasher32<keyType>((uint32_t) seeds)(k) & ((1U << lgMa) - 1);
+    hb = (Hasher32<keyType>((uint32_t) (seeds >> 32))(k) & ((1U << lgMb) - 1)) + (1U << lgMa);
+  }
+
+  static inline uint64_t regionWords(uint8_t lgMa, uint8_t lgMb) {
+    return (((1ULL << lgMa) + (1ULL << lgMb)) * L + 63) / 64;
+  }
+
+  //! L bits of slot index of the region starting at word offset.
+  inline uint64_t slotGet(uint32_t offset, uint32_t index) const {
+    uint64_t bit = (uint64_t) index * L;
+    const uint64_t *p = &arena[offset + (bit >> 6)];
+    uint32_t s = bit & 63;
+    uint64_t v = p[0] >> s;
+    if (s + L > 64) v |= p[1] << (64 - s);
+    return v & LMASK;
+  }
+
+  inline void slotSet(uint32_t offset, uint32_t index, uint64_t v) {
+    uint64_t bit = (uint64_t) index * L;
+    uint64_t *p = &arena[offset + (bit >> 6)];
+    uint32_t s = bit & 63;
+    v &= LMASK;
+    p[0] = (p[0] & ~(LMASK << s)) | (v << s);
+    if (s + L > 64) p[1] = (p[1] & ~(LMASK >> (64 - s))) | (v >> (64 - s));
+  }
+
+public:
+  /*!
+   \brief returns the value of a key of an issuer.
+   \retval false the issuer has no member in this pool.
+   */
+  inline bool query(const issuerType &issuer, const keyType &k, valueType &out) const {
+    uint64_t digest = digestOf(issuer);
+    int i = find(issuer, digest);
+    if (i < 0) return false;
+    const Member &m = members[i];
+    uint32_t ha, hb;
+    getIndexAB(k, seedsOf(digest, m.seed), m.lgMa, m.lgMb, ha, hb);
+    out = (valueType) (slotGet(m.offset, ha) ^ slotGet(m.offset, hb));
+    return true;
+  }
+
+  //! true if the issuer has a member in this pool.
+  inline bool contains(const issuerType &issuer) const {
+    return find(issuer, digestOf(issuer)) >= 0;
+  }
+
+  //! number of members.
+  inline uint32_t size() const {
+    return members.size();
+  }
+
+  //! bytes used by the arena, the directory and the issuers of shared digests, strings with their characters.
+  inline size_t getMemSize() const {
+    size_t bytes = arena.size() * sizeof(uint64_t) + dirDigest.size() * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(Member));
+    for (const auto &entry : shared) {
+      bytes += sizeof(entry) + 2 * sizeof(void*) + entry.second.capacity() * sizeof(issuerType);
+      for (const issuerType &issuer : entry.second)
+        bytes += heapBytes(issuer);
+    }
+    return bytes;
+  }
+
+  //****************************************
+  //*************CONTROL plane
+  //****************************************
+private:
+  //! build scratch, reused across members
+  vector<pair<uint32_t, uint32_t>> edges;
+  vector<uint32_t> adjStart, pos;
+  vector<pair<uint32_t, int32_t>> adj;   //!< (opposite node, key)
+  vector<pair<uint32_t, int32_t>> queue; //!< (node, key it was reached by)
+  vector<uint64_t> nodeVal;
+  DisjointSet disj;
+
+  //! try one seed: test acyclicity, and fill nodeVal so that nodeVal[ha] ^ nodeVal[hb] is the value of each key.
+  bool tryBuild(const vector<keyType> &keys, const vector<valueType> &values, uint32_t n, uint64_t seeds, uint8_t lgMa, uint8_t lgMb) {
+    uint32_t m = (1U << lgMa) + (1U << lgMb);
+    disj.resize(m);
+    disj.reset();
+    edges.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      getIndexAB(keys[i], seeds, lgMa, lgMb, edges[i].first, edges[i].second);
+      if (disj.sameSet(edges[i].first, edges[i].second)) return false;
+      disj.merge(edges[i].first, edges[i].second);
+    }
+
+    adjStart.assign(m + 1, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+      adjStart[edges[i].first + 1]++;
+      adjStart[edges[i].second + 1]++;
+    }
+    for (uint32_t i = 0; i < m; ++i)
+      adjStart[i + 1] += adjStart[i];
+    adj.resize(2 * n);
+    pos.assign(adjStart.begin(), adjStart.end() - 1);
+    for (uint32_t i = 0; i < n; ++i) {
+      adj[pos[edges[i].first]++] = make_pair(edges[i].second, (int32_t) i);
+      adj[pos[edges[i].second]++] = make_pair(edges[i].first, (int32_t) i);
+    }
+
+    // fill every tree from its root, the root value is random
+    nodeVal.resize(m);
+    for (uint32_t r = 0; r < m; ++r) {
+      if (disj.representative(r) != r) continue;
+      nodeVal[r] = ((uint64_t) rand() << 32 ^ rand()) & LMASK;
+      queue.clear();
+      queue.push_back(make_pair(r, -1));
+      for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t node = queue[head].first;
+        int32_t reachedBy = queue[head].second;
+        for (uint32_t j = adjStart[node]; j < adjStart[node + 1]; ++j) {
+          if (adj[j].second == reachedBy) continue;
+          uint32_t to = adj[j].first;
+          nodeVal[to] = ((uint64_t) values[adj[j].second] & LMASK) ^ nodeVal[node];
+          queue.push_back(make_pair(to, adj[j].second));
+        }
+      }
+    }
+    return true;
+  }
+
+  //! allocate a region of words at the end of the arena. The arena always ends with one spare word,
+  //! so the two-word read of a slot never runs past it.
+  uint32_t allocate(uint64_t words) {
+    uint64_t offset = arena.empty() ? 0 : arena.size() - 1;
+    arena.resize(offset + words + 1, 0);
+    return offset;
+  }
+
+public:
+  /*!
+   \brief build or rebuild the member of an issuer from its complete key set. Other members are not touched.
+   \param [in] keys the keys of this issuer, no duplicates
+   \param [in] keycount the number of keys
+   \param [in] values the values of the keys
+   \retval false no acyclic hash pair was found, e.g. because of duplicated keys. The pool is unchanged.
+   */
+  bool setMember(const issuerType &issuer, const vector<keyType> &keys, uint32_t keycount, const vector<valueType> &values) {
+    uint8_t lgMa = 0, lgMb = 0;
+    while ((1ULL << lgMa) < keycount * 1.333334)
+      lgMa++;
+    while ((1ULL << lgMb) < keycount)
+      lgMb++;
+
+    uint64_t digest = digestOf(issuer);
+    Member built;
+    bool succ = false;
+    for (int grow = 0; grow < MAX_GROW && !succ; ++grow, ++lgMa, ++lgMb) {
+      for (int t = 0; t < MAX_REHASH; ++t) {
+        built.seed = grow * MAX_REHASH + t;
+        if ((succ = tryBuild(keys, values, keycount, seedsOf(digest, built.seed), lgMa, lgMb))) break;
+      }
+      if (succ) break;
+    }
+    if (!succ) return false;
+    built.lgMa = lgMa;
+    built.lgMb = lgMb;
+
+    int i = find(issuer, digest);
+    uint64_t words = regionWords(lgMa, lgMb);
+    if (i >= 0 && regionWords(members[i].lgMa, members[i].lgMb) == words) {
+      built.offset = members[i].offset;  // same size, rebuild in place
+    } else {
+      if (i >= 0) garbage += regionWords(members[i].lgMa, members[i].lgMb);
+      built.offset = allocate(words);
+    }
+    uint32_t m = (1U << lgMa) + (1U << lgMb);
+    for (uint32_t j = 0; j < m; ++j)
+      slotSet(built.offset, j, nodeVal[j]);
+
+    if (i >= 0) {
+      members[i] = built;
+    } else {
+      auto first = lower_bound(dirDigest.begin(), dirDigest.end(), digest) - dirDigest.begin();
+      auto pos = upper_bound(dirDigest.begin(), dirDigest.end(), digest) - dirDigest.begin();
+      if (pos > first) shared[digest].push_back(issuer);  // the digest collides, keep the issuer
+      dirDigest.insert(dirDigest.begin() + pos, digest);
+      dirCheck.insert(dirCheck.begin() + pos, checkOf(issuer));
+      members.insert(members.begin() + pos, built);
+    }
+    if (garbage * 2 > arena.size()) compact();
+    return true;
+  }
+
+  /*!
+   \brief remove the member of an issuer.
+   \retval false the issuer has no member in this pool.
+   */
+  bool eraseMember(const issuerType &issuer) {
+    uint64_t digest = digestOf(issuer);
+    int i = find(issuer, digest);
+    if (i < 0) return false;
+    auto later = shared.find(digest);
+    if (later != shared.end()) {
+      // the member after the first of the digest is the first from now on, told apart by its check hash
+      int first = lower_bound(dirDigest.begin(), dirDigest.end(), digest) - dirDigest.begin();
+      later->second.erase(later->second.begin() + (i == first ? 0 : i - first - 1));
+      if (later->second.empty()) shared.erase(later);
+    }
+    garbage += regionWords(members[i].lgMa, members[i].lgMb);
+    dirDigest.erase(dirDigest.begin() + i);
+    dirCheck.erase(dirCheck.begin() + i);
+    members.erase(members.begin() + i);
+    if (garbage * 2 > arena.size()) compact();
+    return true;
+  }
+
+  //! move all members to a new arena without the space of rebuilt and erased members.
+  void compact() {
+    vector<uint64_t> next;
+    for (Member &m : members) {
+      uint64_t words = regionWords(m.lgMa, m.lgMb);
+      next.insert(next.end(), arena.begin() + m.offset, arena.begin() + m.offset + words);
+      m.offset = next.size() - words;
+    }
+    next.push_back(0);
+    next.shrink_to_fit();
+    arena.swap(next);
+    garbage = 0;
+  }
+};
@@ -0,0 +1,105 @@
+#pragma once
+/*!
+ \file persistence.h
+ Binary read/write helpers used by the Othello checkpoint and write-ahead log.
+ All values are written in host byte order; checkpoints are not meant to be moved across architectures.
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <unistd.h>
+
+using namespace std;
+
+//! write a trivially copyable value.
+template<class T>
+inline bool persistWrite(FILE *f, const T &v) {
+  static_assert(std::is_trivially_copyable<T>::value, "persistWrite needs a trivially copyable type");
+  return fwrite(&v, sizeof(T), 1, f) == 1;
+}
+
+//! write a string as a 32-bit length followed by its bytes.
+inline bool persistWrite(FILE *f, const string &s) {
+  uint32_t len = s.size();
+  return persistWrite(f, len) && (len == 0 || fwrite(s.data(), 1, len, f) == len);
+}
+
+template<class K, class V>
+inline bool persistWrite(FILE *f, const pair<K, V> &kv) {
+  return persistWrite(f, kv.first) && persistWrite(f, kv.second);
+}
+
+//! read a trivially copyable value. returns false on a short read.
+template<class T>
+inline bool persistRead(FILE *f, T &v) {
+  static_assert(std::is_trivially_copyable<T>::value, "persistRead needs a trivially copyable type");
+  return fread(&v, sizeof(T), 1, f) == 1;
+}
+
+inline bool persistRead(FILE *f, string &s) {
+  uint32_t len;
+  if (!persistRead(f, len)) return false;
+  s.resize(len);
+  return len == 0 || fread(&s[0], 1, len, f) == len;
+}
+
+template<class K, class V>
+inline bool persistRead(FILE *f, pair<K, V> &kv) {
+  return persistRead(f, kv.first) && persistRead(f, kv.second);
+}
+
+//! write a vector as a 64-bit element count followed by the elements.
+//! vectors of trivially copyable types are written with a single fwrite.
+template<class T>
+inline bool persistWriteVector(FILE *f, const vector<T> &v) {
+  uint64_t n = v.size();
+  if (!persistWrite(f, n)) return false;
+  if (std::is_trivially_copyable<T>::value) {
+    return n == 0 || fwrite(v.data(), sizeof(T), n, f) == n;
+  }
+  for (const T &x : v)
+    if (!persistWrite(f, x)) return false;
+  return true;
+}
+
+//! vector<bool> has no contiguous storage, write it as one byte per element.
+inline bool persistWriteVector(FILE *f, const vector<bool> &v) {
+  uint64_t n = v.size();
+  if (!persistWrite(f, n)) return false;
+  for (bool x : v)
+    if (!persistWrite(f, (uint8_t) x)) return false;
+  return true;
+}
+
+template<class T>
+inline bool persistReadVector(FILE *f, vector<T> &v) {
+  uint64_t n;
+  if (!persistRead(f, n)) return false;
+  v.resize(n);
+  if (std::is_trivially_copyable<T>::value) {
+    return n == 0 || fread(v.data(), sizeof(T), n, f) == n;
+  }
+  for (T &x : v)
+    if (!persistRead(f, x)) return false;
+  return true;
+}
+
+inline bool persistReadVector(FILE *f, vector<bool> &v) {
+  uint64_t n;
+  if (!persistRead(f, n)) return false;
+  v.resize(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    uint8_t x;
+    if (!persistRead(f, x)) return false;
+    v[i] = x;
+  }
+  return true;
+}
+
+//! flush the stdio buffer and the kernel page cache of a file to stable storage.
+inline bool persistSync(FILE *f) {
+  return fflush(f) == 0 && fsync(fileno(f)) == 0;
+}
@@ -0,0 +1,283 @@
+#pragma once
+/*!
+ \file ribbon.h
+ Describes *Ribbon* retrieval: a static function from keys to L-bit values stored in about (1+eps)n*L bits.
+ */
+
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <cassert>
+#include <stdexcept>
+#include "../othello/common.h"
+#include "../othello/hash.h"
+
+using namespace std;
+
+/*!
+ * \brief Ribbon retrieval (standard Ribbon, Dillinger & Walzer). Every key is a row of a banded linear system
+ * over GF(2): it has a start column s and a bandWidth-bit coefficient c with c & 1 == 1, and its value is the
+ * parity of c AND the solution bits [s, s + bandWidth). The system is solved once by on-the-fly Gaussian
+ * elimination of the rows sorted by start, and back substitution.
+ *
+ * Same build/query interface as ControlPlaneOthello, but static: rebuild to change the key set.
+ * Space is (numStarts + bandWidth) * L bits, numStarts = n * (1 + overhead).
+ * \note keys outside the build set return an arbitrary value, as with Othello.
+ */
+template<class keyType, class valueType, uint32_t bandWidth = 64, uint8_t valueLength = 0>
+class RibbonRetrieval {
+  static_assert(bandWidth == 64 || bandWidth == 128, "bandWidth must be 64 or 128");
+  static_assert(sizeof(valueType) * 8 >= valueLength, "sizeof(valueType)*8 < valueLength");
+
+  typedef typename conditional<bandWidth == 64, uint64_t, unsigned __int128>::type coeffType;
+
+private:
+  //*******builtin values
+  const static int MAX_REHASH = 64; //!< number of seed pairs tried before the overhead is increased.
+  const static int MAX_TRIES = 8 * MAX_REHASH; //!< number of seed pairs tried before the build fails, at up to 1.25^7 times the overhead.
+  const static uint32_t L = valueLength ? valueLength : (is_same<valueType, bool>::value ? 1 : sizeof(valueType) * 8); //!< the bit length of return value.
+  const static uint64_t LMASK = ((L == 64) ? (~0ULL) : ((1ULL << L) - 1));
+  const static uint32_t WORDS = bandWidth / 64; //!< 64-bit words spanned by a band.
+
+public:
+  /*!
+   \param [in] overhead extra start positions relative to the key count. 0 picks a default for the band
+   width that builds at the first try with high probability.
+   \throws invalid_argument if a key appears twice with different values, runtime_error if no try builds.
+   */
+  RibbonRetrieval(vector<keyType> &_keys, uint32_t keycount, vector<valueType> &_values, double overhead = 0) {
+    if (overhead <= 0) overhead = (bandWidth == 64) ? 0.08 : 0.04;
+    build(_keys, keycount, _values, overhead);
+  }
+
+  //****************************************
+  //*************DATA Plane
+  //****************************************
+private:
+  /*! solution bits, interleaved per 64 columns: word (col / 64) * L + b holds bit b of the solution
+   of columns [col / 64 * 64, col / 64 * 64 + 64), so one query reads WORDS + 1 adjacent groups.
+   */
+  vector<uint64_t> sol;
+  uint32_t numStarts = 0; //!< number of possible start columns.
+  uint32_t keyCnt = 0;
+  Hasher32<keyType> Ha; //<! hash function Ha
+  Hasher32<keyType> Hb; //<! hash function Hb
+
+  static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  //! compute the row of a key: start column and coefficient (lowest bit set).
+  inline void getRow(const keyType &k, uint32_t &start, coeffType &coeff) const {
+    uint64_t h = mix64(((uint64_t) Ha(k) << 32) | Hb(k));
+    start = ((unsigned __int128) h * numStarts) >> 64;
+    makeCoeff(h, coeff);
+    coeff |= 1;
+  }
+
+  static inline void makeCoeff(uint64_t h, uint64_t &coeff) {
+    coeff = mix64(h ^ 0x9e3779b97f4a7c15ULL);
+  }
+
+  static inline void makeCoeff(uint64_t h, unsigned __int128 &coeff) {
+    coeff = ((unsigned __int128) mix64(h ^ 0x9e3779b97f4a7c15ULL) << 64) | mix64(h + 0x632be59bd9b4e019ULL);
+  }
+
+  static inline int parity(uint64_t x) {
+    return __builtin_parityll(x);
+  }
+
+  static inline int parity(unsigned __int128 x) {
+    return __builtin_parityll((uint64_t) x ^ (uint64_t) (x >> 64));
+  }
+
+  static inline int ctz(uint64_t x) {
+    return __builtin_ctzll(x);
+  }
+
+  static inline int ctz(unsigned __int128 x) {
+    return (uint64_t) x ? __builtin_ctzll((uint64_t) x) : 64 + __builtin_ctzll((uint64_t) (x >> 64));
+  }
+
+  //! result of a row against the solution.
+  inline valueType evalRow(uint32_t start, coeffType coeff) const {
+    const uint64_t *base = &sol[(start >> 6) * L];
+    uint32_t shift = start & 63;
+    valueType v = 0;
+    for (uint32_t b = 0; b < L; ++b) {
+      // the band of bit plane b: columns [start, start + bandWidth)
+      coeffType window = base[b] >> shift;
+      for (uint32_t w = 1; w <= WORDS; ++w) {
+        if (shift) window |= (coeffType) base[w * L + b] << (64 * w - shift);
+        else if (w < WORDS) window |= (coeffType) base[w * L + b] << (64 * w);
+      }
+      v |= (valueType) ((uint64_t) parity(window & coeff) << b);
+    }
+    return v;
+  }
+
+public:
+  /*!
+   \brief returns the value of a key.
+   */
+  inline valueType query(const keyType &k) const {
+    uint32_t start;
+    coeffType coeff;
+    getRow(k, start, coeff);
+    return evalRow(start, coeff);
+  }
+
+  /*!
+   \brief query a batch of keys. All rows are hashed and their solution words prefetched
+   before any is evaluated, so the memory accesses of a batch overlap.
+   \param [in] keys n pointers to keys
+   \param [out] out n values
+   */
+  void queryBatch(const keyType * const *keys, uint32_t n, valueType *out) const {
+    const static uint32_t BATCH = 16;
+    uint32_t starts[BATCH];
+    coeffType coeffs[BATCH];
+    for (uint32_t i = 0; i < n; i += BATCH) {
+      uint32_t cnt = min(BATCH, n - i);
+      for (uint32_t j = 0; j < cnt; ++j) {
+        getRow(*keys[i + j], starts[j], coeffs[j]);
+        __builtin_prefetch(&sol[(starts[j] >> 6) * L]);
+        __builtin_prefetch(&sol[(starts[j] >> 6) * L + WORDS * L]);
+      }
+      for (uint32_t j = 0; j < cnt; ++j) {
+        out[i + j] = evalRow(starts[j], coeffs[j]);
+      }
+    }
+  }
+
+  //! bytes used by the solution.
+  inline size_t getMemSize() const {
+    return sol.size() * sizeof(uint64_t);
+  }
+
+  inline uint32_t size() const {
+    return keyCnt;
+  }
+
+  //****************************************
+  //*************CONTROL plane
+  //****************************************
+private:
+  struct Row {
+    uint32_t start;
+    coeffType coeff;
+    uint64_t value;
+  };
+
+  //! gen new hash seed pair
+  void newHash() {
+    Ha.setSeed(rand());
+    Hb.setSeed(rand());
+  }
+
+  //! Gaussian elimination of rows sorted by start. Row i of the banded matrix is kept in C[i]/R[i] with
+  //! its leading 1 at column i. Fails if a row reduces to 0 with a non-zero value.
+  bool solve(const vector<Row> &rows, uint32_t numCols) {
+    vector<coeffType> C(numCols, 0);
+    vector<uint64_t> R(numCols, 0);
+
+    for (const Row &row : rows) {
+      uint32_t i = row.start;
+      coeffType c = row.coeff;
+      uint64_t r = row.value;
+      while (true) {
+        if (C[i] == 0) {
+          C[i] = c;
+          R[i] = r;
+          break;
+        }
+        c ^= C[i];
+        r ^= R[i];
+        if (c == 0) {
+          if (r != 0) return false;
+          break;  // duplicated row with an identical value
+        }
+        uint32_t tz = ctz(c);
+        c >>= tz;
+        i += tz;
+      }
+    }
+
+    // back substitution from the last column. state holds the solution bits of the band after column i.
+    uint32_t numBlocks = (numCols + 63) / 64;
+    sol.assign((numBlocks + WORDS) * L, 0);
+    vector<coeffType> state(L, 0);
+    for (uint32_t i = numCols; i-- > 0;) {
+      for (uint32_t b = 0; b < L; ++b) {
+        state[b] <<= 1;
+        uint64_t bit = ((R[i] >> b) & 1) ^ parity(C[i] & state[b]);
+        state[b] |= bit;
+        sol[(i >> 6) * L + b] |= bit << (i & 63);
+      }
+    }
+    return true;
+  }
+
+  //! true if two keys are equal but their values are not. Their rows are equal under every seed pair, so
+  //! no try can solve them; equal keys with equal values are dropped by solve.
+  bool hasConflictingDuplicates(vector<keyType> &keys, uint32_t keycount, vector<valueType> &values) const {
+    vector<uint32_t> order(keycount);
+    for (uint32_t i = 0; i < keycount; ++i)
+      order[i] = i;
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+    for (uint32_t i = 1, first = 0; i < keycount; ++i) {
+      if (!(keys[order[first]] == keys[order[i]])) {
+        first = i;
+      } else if (((uint64_t) values[order[first]] & LMASK) != ((uint64_t) values[order[i]] & LMASK)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void build(vector<keyType> &keys, uint32_t keycount, vector<valueType> &values, double overhead) {
+    keyCnt = keycount;
+    vector<Row> rows(keycount);
+    vector<Row> sorted(keycount);
+
+    for (uint32_t tryCount = 1; tryCount <= MAX_TRIES; ++tryCount) {
+      numStarts = max(1U, (uint32_t) (keycount * (1 + overhead)));
+      newHash();
+
+      // counting sort by start, so elimination walks the matrix front to back
+      vector<uint32_t> bucket(numStarts + 1, 0);
+      for (uint32_t i = 0; i < keycount; ++i) {
+        getRow(keys[i], rows[i].start, rows[i].coeff);
+        rows[i].value = (uint64_t) values[i] & LMASK;
+        bucket[rows[i].start + 1]++;
+      }
+      for (uint32_t i = 0; i < numStarts; ++i)
+        bucket[i + 1] += bucket[i];
+      for (uint32_t i = 0; i < keycount; ++i)
+        sorted[bucket[rows[i].start]++] = rows[i];
+
+      if (solve(sorted, numStarts + bandWidth - 1)) {
+        if (tryCount > 1) {
+          cout << "Ribbon built " << human(keyCnt) << " Keys, overhead " << overhead << " after " << tryCount << " tries" << endl;
+        }
+        return;
+      }
+      // the first failure is checked for keys that no seed pair can solve, the rest are retried
+      if (tryCount == 1 && hasConflictingDuplicates(keys, keycount, values)) {
+        throw invalid_argument("Ribbon: a key appears twice with different values");
+      }
+      if (tryCount % MAX_REHASH == 0) {
+        overhead *= 1.25;
+      }
+    }
+    cout << "Ribbon build fail! " << human(keyCnt) << " Keys, overhead " << overhead << " after " << MAX_TRIES << " tries" << endl;
+    throw runtime_error("Ribbon: no seed pair solves the keys");
+  }
+};
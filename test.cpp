@@ -5,8 +5,16 @@
 #include <sys/time.h>
 #include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <thread>
 #include "mlbf/mlbf.hpp"
+#include "mlbf/frozen_mlbf.hpp"
+#include "mlbf/planner.hpp"
+#include "mlbf/mlbf_updater.hpp"
 #include "othello/control_plane_othello.h"
+#include "othello/data_plane_othello.h"
+#include "othello/othello_pool.h"
+#include "ribbon/ribbon.h"
 
 using namespace std;
 
@@ -75,21 +83,117 @@ public:
   }
 };
 
+class RibbonStorage: public TestBase {
+public:
+  RibbonRetrieval<Key, Val>* rib;
+
+  virtual void build(vector<string>& _revoked, vector<string>& _stay) {
+    vector<Key> all_keys(_revoked);
+    all_keys.insert(all_keys.end(), _stay.begin(), _stay.end());
+    vector<Val> all_values(_revoked.size(), REVOKED_FLAG);
+    all_values.resize(all_keys.size(), STAY_FLAG);
+
+    gettimeofday(&sStart, NULL);
+    rib = new RibbonRetrieval<Key, Val>(all_keys, all_keys.size(), all_values);
+    gettimeofday(&sEnd, NULL);
+    cout << "Ribbon build time: " << diffs_ms(sEnd, sStart) << "ms\n";
+  }
+
+  inline virtual Val query(Key& k) {
+    return rib->query(k);
+  }
+
+  inline void queryBatch(const Key* const* keys, uint32_t n, Val* out) {
+    rib->queryBatch(keys, n, out);
+  }
+
+  inline virtual size_t getMemSize() {
+    return rib->getMemSize();
+  }
+};
+
+// the data sets carry no issuer, so the keys are split into 4096 pseudo issuers by their first 3 hex digits
+class PoolStorage: public TestBase {
+public:
+  OthelloPool<Key, Key, Val> pool;
+
+  static inline uint32_t issuerIndex(const Key& k) {
+    return stoul(issuerOf(k), NULL, 16);
+  }
+
+  static inline Key issuerOf(const Key& k) {
+    return k.substr(0, 3);
+  }
+
+  virtual void build(vector<string>& _revoked, vector<string>& _stay) {
+    vector<vector<Key>> keys(4096);
+    vector<vector<Val>> values(4096);
+    for (size_t i = 0; i < _revoked.size(); ++i) {
+      keys[issuerIndex(_revoked[i])].push_back(_revoked[i]);
+      values[issuerIndex(_revoked[i])].push_back(REVOKED_FLAG);
+    }
+    for (size_t i = 0; i < _stay.size(); ++i) {
+      keys[issuerIndex(_stay[i])].push_back(_stay[i]);
+      values[issuerIndex(_stay[i])].push_back(STAY_FLAG);
+    }
+
+    gettimeofday(&sStart, NULL);
+    for (uint32_t issuer = 0; issuer < keys.size(); ++issuer) {
+      if (!keys[issuer].empty()) {
+        pool.setMember(issuerOf(keys[issuer][0]), keys[issuer], keys[issuer].size(), values[issuer]);
+      }
+    }
+    gettimeofday(&sEnd, NULL);
+    cout << "Pool build time: " << diffs_ms(sEnd, sStart) << "ms, " << pool.size() << " members\n";
+  }
+
+  inline virtual Val query(Key& k) {
+    Val v = STAY_FLAG;
+    pool.query(issuerOf(k), k, v);
+    return v;
+  }
+
+  inline virtual size_t getMemSize() {
+    return pool.getMemSize();
+  }
+};
+
 class MLBFStorage: public TestBase {
 public:
   // cuckoohash_map<string, string, Hasher32<string>> cuckoo_table;
   MLBFilter* mlbf;
+  vector<FilterKind> kinds;  // filter type of the levels
+  size_t upFront = 0;        // levels containsUpFront probes at a time, 0 for contains
+
+  MLBFStorage(vector<FilterKind> _kinds = vector<FilterKind>()) : kinds(_kinds) {
+  }
 
   virtual void build(vector<string>& _revoked, vector<string>& _stay) {
     gettimeofday(&sStart, NULL);
     float firstFpRate = _revoked.size() * sqrt(0.5) / _stay.size();
-    mlbf = new MLBFilter(_revoked.size(), _stay.size(), _revoked, _stay, firstFpRate, 0.5);
+    mlbf = new MLBFilter(_revoked.size(), _stay.size(), _revoked, _stay, firstFpRate, 0.5, max(1U, thread::hardware_concurrency()), kinds);
     gettimeofday(&sEnd, NULL);
-    cout << "MLBF build time: " << diffs_ms(sEnd, sStart) << "ms\n";
+    cout << "MLBF build time: " << diffs_ms(sEnd, sStart) << "ms, " << mlbf->numLevels() << " levels, "
+         << mlbf->layout().expectedDepth << " levels per query\n";
+    printFirstLevel();
+  }
+
+  // the level-1 pass: all revoked keys inserted, all non-revoked keys checked
+  void printFirstLevel() {
+    const MLBFLevelPlan& first = mlbf->layout().levels[0];
+    cout << "  level 1 insert " << first.insertMs << "ms, check " << first.checkMs << "ms\n";
   }
 
   inline virtual Val query(Key& k) {
-    return mlbf->contains(k);
+    return upFront ? mlbf->containsUpFront(k, upFront) : mlbf->contains(k);
+  }
+
+  inline void queryBatch(const Key* const* keys, uint32_t n, Val* out) {
+    vector<uint64_t> bitmap((n + 63) / 64);
+    mlbf->containsBatch(keys, n, bitmap.data());
+    for (uint32_t i = 0; i < n; ++i) {
+      out[i] = (bitmap[i / 64] >> (i % 64)) & 1;
+    }
   }
   
   inline virtual size_t getMemSize() {
@@ -97,12 +201,284 @@ public:
   }
 };
 
+// an MLBF whose level fp rates and hash counts come from MLBFPlanner
+class PlannedMLBFStorage: public MLBFStorage {
+public:
+  FilterKind kind;
+  int saltTrials;  // salts tried per level
+  size_t residual, maxLevels;  // bounds of the cascade before its exact last level
+  bf::hash_family family;
+
+  PlannedMLBFStorage(FilterKind _kind = BASIC_BLOOM, int _saltTrials = 1, size_t _residual = 0, size_t _maxLevels = 0,
+                     bf::hash_family _family = bf::hash_family::h3)
+    : kind(_kind), saltTrials(_saltTrials), residual(_residual), maxLevels(_maxLevels), family(_family) {
+  }
+
+  virtual void build(vector<string>& _revoked, vector<string>& _stay) {
+    gettimeofday(&sStart, NULL);
+    MLBFPlan plan = MLBFPlanner::plan(_revoked.size(), _stay.size(), kind);
+    gettimeofday(&sEnd, NULL);
+    cout << "MLBF plan time: " << diffs_ms(sEnd, sStart) << "ms, " << plan.levels.size() << " levels, "
+         << plan.bits / 8 / 1024 << "KB, " << plan.expectedProbes << " probes per query predicted\n";
+    for (size_t i = 0; i < plan.levels.size() && i < 3; i++) {
+      cout << "  level " << i + 1 << (i == 2 ? "+" : "") << " fp " << plan.levels[i].fpRate << " k " << plan.levels[i].k << "\n";
+    }
+    gettimeofday(&sStart, NULL);
+    mlbf = new MLBFilter(_revoked, _stay, plan, max(1U, thread::hardware_concurrency()), saltTrials, residual, maxLevels, family);
+    gettimeofday(&sEnd, NULL);
+    const MLBFPlan& built = mlbf->layout();
+    cout << "Planned MLBF (" << saltTrials << " salts per level) build time: " << diffs_ms(sEnd, sStart) << "ms, " << mlbf->numLevels() << " levels, "
+         << built.expectedDepth << " levels and " << built.expectedProbes << " probes per query\n";
+    printFirstLevel();
+  }
+};
+
+class FrozenMLBFStorage: public TestBase {
+public:
+  FrozenMLBFilter* frozen;
+  size_t inflight = 16;  // keys interleaved by queryBatch
+
+  // freezes a built MLBF
+  void build(MLBFilter& mlbf) {
+    gettimeofday(&sStart, NULL);
+    frozen = new FrozenMLBFilter(mlbf);
+    gettimeofday(&sEnd, NULL);
+    cout << "MLBF freeze time: " << diffs_ms(sEnd, sStart) << "ms\n";
+  }
+
+  // maps a filter saved by FrozenMLBFilter::save
+  void load(const string& path) {
+    gettimeofday(&sStart, NULL);
+    frozen = new FrozenMLBFilter(path);
+    gettimeofday(&sEnd, NULL);
+    cout << "MLBF map time: " << diffs_ms(sEnd, sStart) << "ms\n";
+  }
+
+  virtual void build(vector<string>& _revoked, vector<string>& _stay) {
+    float firstFpRate = _revoked.size() * sqrt(0.5) / _stay.size();
+    MLBFilter mlbf(_revoked.size(), _stay.size(), _revoked, _stay, firstFpRate, 0.5);
+    build(mlbf);
+  }
+
+  inline virtual Val query(Key& k) {
+    return frozen->contains(k);
+  }
+
+  inline void queryBatch(const Key* const* keys, uint32_t n, Val* out) {
+    vector<uint64_t> bitmap((n + 63) / 64);
+    frozen->containsBatch(keys, n, bitmap.data(), inflight);
+    for (uint32_t i = 0; i < n; ++i) {
+      out[i] = (bitmap[i / 64] >> (i % 64)) & 1;
+    }
+  }
+
+  inline virtual size_t getMemSize() {
+    return frozen->bytesize();
+  }
+};
+
 OthelloStorage o;
+RibbonStorage r;
+PoolStorage p;
 MLBFStorage m;
+MLBFStorage mb(vector<FilterKind>(1, BLOCKED_BLOOM));
+MLBFStorage mf(vector<FilterKind>(1, BINARY_FUSE));
+PlannedMLBFStorage mp;
+PlannedMLBFStorage ms(BASIC_BLOOM, 8);
+PlannedMLBFStorage mx(BASIC_BLOOM, 1, 256, 12);
+PlannedMLBFStorage mc(BASIC_BLOOM, 1, 0, 0, bf::hash_family::crc32c);
+PlannedMLBFStorage mm(BASIC_BLOOM, 1, 0, 0, bf::hash_family::mix64);
+PlannedMLBFStorage mpf(BINARY_FUSE);
+FrozenMLBFStorage f;
+FrozenMLBFStorage fm;
+FrozenMLBFStorage ff;
 
 vector<Key> revoked;
 vector<Key> stay;
 
+// a refresh in which 0.5% of the revoked keys expire and as many keys are newly revoked,
+// rebuilt from the layout of the planned build
+void deltaUpdate() {
+  size_t moved = revoked.size() / 200;
+  vector<Key> revoked2(revoked.begin() + moved, revoked.end());
+  revoked2.insert(revoked2.end(), stay.begin(), stay.begin() + moved);
+  vector<Key> stay2(stay.begin() + moved, stay.end());
+  MLBFilter refreshed(revoked2, stay2, mp.mlbf->layout(), max(1U, thread::hardware_concurrency()));
+  FrozenMLBFilter before(*mp.mlbf), after(refreshed);
+  vector<uint8_t> delta = FrozenMLBFilter::delta(before, after);
+  before.applyDelta(delta);
+  cout << "MLBF delta for " << moved << " expired and " << moved << " newly revoked keys: " << delta.size() / 1024.0 << "KB, full filter "
+       << after.bytesize() / 1024.0 << "KB, applied " << (before.contentChecksum() == after.contentChecksum() ? "ok" : "wrong") << "\n";
+}
+
+// the exact-tail build rebuilt from its own layout, whose last level is planned as EXACT_SET
+void exactTailRebuild() {
+  timeval start, end;
+  gettimeofday(&start, NULL);
+  MLBFilter rebuilt(revoked, stay, mx.mlbf->layout(), max(1U, thread::hardware_concurrency()));
+  gettimeofday(&end, NULL);
+  size_t errors = 0;
+  for (size_t i = 0; i < revoked.size(); i++) {
+    errors += !rebuilt.contains(revoked[i]);
+  }
+  for (size_t i = 0; i < stay.size(); i++) {
+    errors += rebuilt.contains(stay[i]);
+  }
+  FrozenMLBFilter frozen(rebuilt);
+  cout << "Exact-tail MLBF rebuilt from its layout: " << diffs_ms(end, start) << "ms, " << rebuilt.numLevels() << " levels, "
+       << rebuilt.bytesize() / 1024.0 << "KB, frozen " << frozen.bytesize() / 1024.0 << "KB, errors " << errors << "\n";
+}
+
+// the frozen filters in transport form: packed size against the raw bits, and decode speed
+void packedTransfer() {
+  FrozenMLBFilter planned(*mp.mlbf);
+  const FrozenMLBFilter* filters[] = {f.frozen, &planned, ff.frozen};
+  const char* names[] = {"MLBF", "planned MLBF", "planned fuse MLBF"};
+  for (size_t i = 0; i < 3; i++) {
+    vector<uint8_t> packed = filters[i]->pack();
+    const int rounds = 200;
+    for (int threads : {1, 4}) {
+      timeval start, end;
+      bool same = true;
+      gettimeofday(&start, NULL);
+      for (int round = 0; round < rounds; round++) {
+        FrozenMLBFilter unpacked(packed, threads);
+        same = same && unpacked.contentChecksum() == filters[i]->contentChecksum();
+      }
+      gettimeofday(&end, NULL);
+      double us = diffs_us(end, start) / (double) rounds;
+      cout << "Packed " << names[i] << ": " << packed.size() / 1024.0 << "KB, raw " << filters[i]->bytesize() / 1024.0 << "KB, "
+           << threads << " threads decode " << us << "us, " << filters[i]->bytesize() / us / 1000.0 << "GB/s of filter, "
+           << (same ? "same filter" : "wrong filter") << "\n";
+    }
+  }
+}
+
+// time from revocation to a queryable answer: incremental updates against a full re-cascade.
+// half the revoked keys come from S, half are new keys in neither set
+void incrementalUpdate() {
+  const size_t batch = 100;
+  MLBFUpdater updater(revoked, stay, MLBFPlanner::plan(revoked.size(), stay.size()), max(1U, thread::hardware_concurrency()));
+  vector<Key> fresh;
+  for (size_t i = 0; i < batch; i++) {
+    fresh.push_back("new revocation " + to_string(i));
+  }
+  timeval start, end;
+  gettimeofday(&start, NULL);
+  for (size_t i = 0; i < batch; i++) {
+    updater.revoke(stay[i]);
+    updater.revoke(fresh[i]);
+  }
+  gettimeofday(&end, NULL);
+  int revokeUs = diffs_us(end, start);
+  gettimeofday(&start, NULL);
+  size_t conflicts = updater.fold();
+  gettimeofday(&end, NULL);
+  int foldMs = diffs_ms(end, start);
+
+  auto errors = [&]() {
+    size_t wrong = 0;
+    for (size_t i = 0; i < revoked.size(); i++) {
+      wrong += !updater.contains(revoked[i]);
+    }
+    for (size_t i = 0; i < stay.size(); i++) {
+      wrong += updater.contains(stay[i]) != (i < batch);
+    }
+    for (size_t i = 0; i < batch; i++) {
+      wrong += !updater.contains(fresh[i]);
+    }
+    return wrong;
+  };
+  cout << "MLBF update: " << 2 * batch << " revocations in " << revokeUs << "us, fold " << foldMs << "ms, "
+       << conflicts << " conflicts, side set " << updater.sideSize() << ", errors " << errors() << "\n";
+
+  gettimeofday(&start, NULL);
+  updater.recascade();
+  gettimeofday(&end, NULL);
+  cout << "MLBF re-cascade: " << diffs_ms(end, start) << "ms, errors " << errors() << "\n";
+}
+
+// checkpoint a control plane, keep mutating it with the write-ahead log attached, then restore
+// from the checkpoint and the logs and compare every key
+void othelloPersistence() {
+  size_t n = min<size_t>(100000, min(revoked.size(), stay.size() / 2));
+  const size_t changes = 1000;
+  vector<Key> keys(revoked.begin(), revoked.begin() + n);
+  keys.insert(keys.end(), stay.begin(), stay.begin() + n);
+  vector<Val> values(n, REVOKED_FLAG);
+  values.resize(2 * n, STAY_FLAG);
+  ControlPlaneOthello<Key, Val> oth(keys, keys.size(), values);
+
+  const string checkpointPath = "othello.ckpt", logPath = "othello.wal";
+  oth.attachLog(logPath);
+  oth.checkpoint(checkpointPath);
+  for (size_t i = 0; i < changes; i++) {
+    oth.insert(make_pair(stay[n + i], REVOKED_FLAG));
+    oth.erase(stay[i]);
+  }
+  // a second checkpoint retires the first log, the restore replays only what follows it
+  oth.checkpoint(checkpointPath);
+  for (size_t i = 0; i < changes; i++) {
+    oth.updateValueAt(oth.queryIndex(revoked[i]), STAY_FLAG);
+    oth.insert(make_pair(stay[n + changes + i], STAY_FLAG));
+  }
+  oth.syncLog();
+  oth.waitCheckpoint();
+
+  timeval start, end;
+  gettimeofday(&start, NULL);
+  unique_ptr<ControlPlaneOthello<Key, Val>> restored(ControlPlaneOthello<Key, Val>::restore(checkpointPath, logPath));
+  gettimeofday(&end, NULL);
+  size_t errors = 0;
+  if (!restored) {
+    errors = 1;
+  } else {
+    keys.insert(keys.end(), stay.begin() + n, stay.begin() + n + 2 * changes);
+    errors += restored->size() != oth.size();
+    for (Key& k : keys) {
+      bool member = oth.isMember(k);
+      errors += restored->isMember(k) != member || (member && restored->query(k) != oth.query(k));
+    }
+  }
+  cout << "Othello restore of " << oth.size() << " keys and " << 2 * changes << " logged changes: " << diffs_ms(end, start)
+       << "ms, errors " << errors << "\n";
+  restored.reset();
+  remove(checkpointPath.c_str());
+  for (int seq = 0; seq < 3; seq++) {
+    remove((logPath + "." + to_string(seq)).c_str());
+  }
+}
+
+// fingerprint-verified membership on the data plane: every built key must pass, and keys outside the
+// set should pass at about 2^-bits
+void othelloFingerprint() {
+  size_t n = stay.size() / 2;
+  vector<Key> keys(revoked.begin(), revoked.end());
+  keys.insert(keys.end(), stay.begin(), stay.begin() + n);
+  vector<Val> values(revoked.size(), REVOKED_FLAG);
+  values.resize(keys.size(), STAY_FLAG);
+  ControlPlaneOthello<Key, Val> oth(keys, keys.size(), values);
+  for (uint8_t bits : {8, 12, 16}) {
+    oth.enableFingerprint(bits);
+    DataPlaneOthello<Key, Val> data(oth);
+    size_t rejects = 0, wrong = 0, accepts = 0;
+    Val v;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (!data.queryMember(keys[i], v)) {
+        rejects++;
+      } else {
+        wrong += v != values[i];
+      }
+    }
+    for (size_t i = n; i < stay.size(); i++) {
+      accepts += data.queryMember(stay[i], v);
+    }
+    cout << "Othello fingerprint " << (int) bits << " bits: " << rejects << " members rejected, " << wrong << " wrong values, "
+         << 100.0 * accepts / (stay.size() - n) << "% of non-members accepted, expected " << 100.0 / (1 << bits) << "%, "
+         << oth.getFingerprintMemSize() * sizeof(uint64_t) / 1024.0 << "KB\n";
+  }
+}
+
 int loadData(char* revoked_filename, char* stay_filename) {
   string value;
   
@@ -137,40 +513,69 @@ int loadData(char* revoked_filename, char* stay_filename) {
   stay_data.close();
  
   o.build(revoked, stay);
+  othelloPersistence();
+  othelloFingerprint();
+  r.build(revoked, stay);
+  p.build(revoked, stay);
   m.build(revoked, stay);
+  mb.build(revoked, stay);
+  mf.build(revoked, stay);
+  mp.build(revoked, stay);
+  ms.build(revoked, stay);
+  mx.build(revoked, stay);
+  mc.build(revoked, stay);
+  mm.build(revoked, stay);
+  mpf.build(revoked, stay);
+  f.build(*m.mlbf);
+  ff.build(*mpf.mlbf);
+  deltaUpdate();
+  exactTailRebuild();
+  packedTransfer();
+  incrementalUpdate();
+  // the mapping outlives the file
+  f.frozen->save("mlbf.frozen");
+  fm.load("mlbf.frozen");
+  remove("mlbf.frozen");
   
   // memory usage
   cout << "Othello size: " << o.getMemSize() / 1024.0 / 1024.0 << "MB\n";
+  cout << "Ribbon size: " << r.getMemSize() / 1024.0 / 1024.0 << "MB\n";
+  cout << "Pool size: " << p.getMemSize() / 1024.0 / 1024.0 << "MB\n";
   cout << "MLBF size: " << m.getMemSize() / 1024.0 / 1024.0 << "MB\n";
+  cout << "Frozen MLBF size: " << f.getMemSize() / 1024.0 / 1024.0 << "MB\n";
+  cout << "Blocked MLBF size: " << mb.getMemSize() / 1024.0 / 1024.0 << "MB\n";
+  cout << "Planned MLBF size: " << mp.getMemSize() / 1024.0 / 1024.0 << "MB, "
+       << 100.0 - 100.0 * mp.getMemSize() / m.getMemSize() << "% smaller than the fixed rates, "
+       << m.mlbf->layout().expectedProbes << " -> " << mp.mlbf->layout().expectedProbes << " probes per query\n";
+  cout << "Exact-tail MLBF size: " << mx.getMemSize() / 1024.0 / 1024.0 << "MB, " << mx.mlbf->numLevels() << " levels at most, "
+       << mx.mlbf->layout().expectedDepth << " levels per query\n";
+  cout << "Fuse MLBF size: " << mf.getMemSize() / 1024.0 / 1024.0 << "MB, " << 100.0 - 100.0 * mf.getMemSize() / m.getMemSize()
+       << "% smaller than the Bloom levels, " << mf.mlbf->numLevels() << " levels\n";
+  cout << "Planned fuse MLBF size: " << mpf.getMemSize() / 1024.0 / 1024.0 << "MB, " << 100.0 - 100.0 * mpf.getMemSize() / mp.getMemSize()
+       << "% smaller than the planned Bloom levels, " << mpf.mlbf->numLevels() << " levels, "
+       << mpf.mlbf->layout().expectedProbes << " probes per query\n";
+  cout << "Salt-searched MLBF size: " << ms.getMemSize() / 1024.0 / 1024.0 << "MB, " << ms.mlbf->numLevels() << " levels, "
+       << ms.mlbf->layout().expectedProbes << " probes per query\n";
   return 0;
 }
 
-void queryAll() {
+template<class Storage>
+void queryStorage(const char* name, Storage& s, vector<int>& randomIndex) {
   struct timeval qStart, qEnd;
-  int queryTimes = 10000000;
-  vector<int> randomIndex;
-  int totalNum = revoked.size() + stay.size();
-  
-  cout << "query " << queryTimes << " times\n";
-  
-  // generate key(index) to be queried
-  for (int i = 0; i < queryTimes; i++) {
-    randomIndex.push_back(rand() % totalNum);
-  }
-  
-  // start query
-  cout << "---Othello---" << endl;
+  int queryTimes = randomIndex.size();
+
+  cout << "---" << name << "---" << endl;
   gettimeofday(&qStart, NULL);
   int error = 0;  
   for (int i = 0; i < queryTimes; i++) {
     int idx = randomIndex[i];
     if (idx < revoked.size()) {
-      if (o.query(revoked[idx]) != REVOKED_FLAG) {
+      if (s.query(revoked[idx]) != REVOKED_FLAG) {
         error += 1;
       }
     } else {
       idx = idx - revoked.size();
-      if (o.query(stay[idx]) != STAY_FLAG) {
+      if (s.query(stay[idx]) != STAY_FLAG) {
         error += 1;
       }
     }
@@ -179,29 +584,233 @@ void queryAll() {
   gettimeofday(&qEnd, NULL);
   cout << "Average query time: " << diffs_us(qEnd, qStart) / (queryTimes * 1.0) << "us\n";
   cout << "Query Throughout is: " << 1000000.0 * queryTimes / diffs_us(qEnd, qStart) << '\n';
-  
-  cout << "---MLBF---" << endl;
+}
+
+// same queries through a batch API, keys are passed by pointer
+template<class Storage>
+void queryStorageBatch(const char* name, Storage& s, vector<int>& randomIndex) {
+  struct timeval qStart, qEnd;
+  int queryTimes = randomIndex.size();
+  vector<const Key*> keys(queryTimes);
+  for (int i = 0; i < queryTimes; i++) {
+    size_t idx = randomIndex[i];
+    keys[i] = idx < revoked.size() ? &revoked[idx] : &stay[idx - revoked.size()];
+  }
+  unique_ptr<Val[]> results(new Val[queryTimes]);
+
+  cout << "---" << name << "---" << endl;
   gettimeofday(&qStart, NULL);
-  error = 0;  
+  s.queryBatch(keys.data(), queryTimes, results.get());
+  gettimeofday(&qEnd, NULL);
+  int error = 0;
   for (int i = 0; i < queryTimes; i++) {
-    int idx = randomIndex[i];
-    if (idx < revoked.size()) {
-      if (m.query(revoked[idx]) != REVOKED_FLAG) {
-        error += 1;
-      }
-    } else {
-      idx = idx - revoked.size();
-      if (m.query(stay[idx]) != STAY_FLAG) {
-        error += 1;
-      }
+    if (results[i] != ((size_t) randomIndex[i] < revoked.size() ? REVOKED_FLAG : STAY_FLAG)) {
+      error += 1;
     }
   }
   cout << "Error count " << error << endl;
-  gettimeofday(&qEnd, NULL);
   cout << "Average query time: " << diffs_us(qEnd, qStart) / (queryTimes * 1.0) << "us\n";
   cout << "Query Throughout is: " << 1000000.0 * queryTimes / diffs_us(qEnd, qStart) << '\n';
 }
 
+// lookup throughput and false-positive rate of a 1% Bloom filter over R with every hash
+// family, for the keys as loaded and for keys repeated to 96 bytes, past the H3 tables
+void compareHashFamilies(vector<int>& randomIndex) {
+  const char* names[] = {"H3", "CRC32-C", "multiply-mix"};
+  bf::hash_family families[] = {bf::hash_family::h3, bf::hash_family::crc32c, bf::hash_family::mix64};
+  for (size_t length : {size_t(0), size_t(96)}) {
+    auto widen = [&](const Key& k) {
+      Key wide = k;
+      while (length > 0 && wide.size() < length) {
+        wide += k;
+      }
+      return length > 0 ? wide.substr(0, length) : wide;
+    };
+    vector<Key> r, s;
+    for (const Key& k : revoked) r.push_back(widen(k));
+    for (const Key& k : stay) s.push_back(widen(k));
+
+    for (size_t i = 0; i < 3; i++) {
+      bf::basic_bloom_filter filter(0.01, r.size(), 0, true, 7, 0, families[i]);
+      for (const Key& k : r) {
+        filter.add(k);
+      }
+      size_t fps = 0;
+      for (const Key& k : s) {
+        fps += filter.lookup(k);
+      }
+      struct timeval qStart, qEnd;
+      size_t hits = 0;
+      gettimeofday(&qStart, NULL);
+      for (int idx : randomIndex) {
+        hits += filter.lookup(idx < (int) r.size() ? r[idx] : s[idx - r.size()]);
+      }
+      gettimeofday(&qEnd, NULL);
+      cout << "---Bloom filter, " << names[i] << ", " << (length > 0 ? "96-byte" : "loaded") << " keys---\n"
+           << "FP rate " << 100.0 * fps / s.size() << "%, " << hits << " hits\n"
+           << "Query Throughout is: " << 1000000.0 * randomIndex.size() / diffs_us(qEnd, qStart) << '\n';
+    }
+  }
+}
+
+// one Bloom filter of R, the first level of a cascade, queried key by key and in batches
+void compareBloomBatch(vector<int>& randomIndex) {
+  for (size_t k : {size_t(1), size_t(7)}) {
+    bf::basic_bloom_filter filter(0.01, revoked.size(), 0, true, k);
+    for (const Key& key : revoked) {
+      filter.add(key);
+    }
+    vector<bf::object> objects;
+    for (int idx : randomIndex) {
+      const Key& key = idx < (int) revoked.size() ? revoked[idx] : stay[idx - revoked.size()];
+      objects.emplace_back(key.data(), key.size());
+    }
+    struct timeval qStart, qEnd;
+    size_t hits = 0;
+    gettimeofday(&qStart, NULL);
+    for (const bf::object& o : objects) {
+      hits += filter.lookup(o);
+    }
+    gettimeofday(&qEnd, NULL);
+    double single = 1000000.0 * objects.size() / diffs_us(qEnd, qStart);
+
+    vector<uint64_t> bitmap((objects.size() + 63) / 64);
+    size_t batchHits = 0;
+    gettimeofday(&qStart, NULL);
+    for (size_t base = 0; base < objects.size(); base += 1024) {
+      filter.lookup_batch(objects.data() + base, min<size_t>(1024, objects.size() - base), bitmap.data() + base / 64);
+    }
+    gettimeofday(&qEnd, NULL);
+    for (uint64_t word : bitmap) {
+      batchHits += __builtin_popcountll(word);
+    }
+    cout << "---Bloom filter batch, k = " << k << "---\n"
+         << hits << " hits, " << batchHits << " in batches\n"
+         << "Query Throughout is: " << single << ", in batches " << 1000000.0 * objects.size() / diffs_us(qEnd, qStart) << '\n';
+  }
+}
+
+// a Bloom filter far larger than the loaded sets, filled key by key and with add_all
+void compareBulkInsert() {
+  vector<Key> keys;
+  for (size_t i = 0; i < 4000000; i++) {
+    keys.push_back(revoked[i % revoked.size()] + to_string(i));
+  }
+  vector<bf::object> objects;
+  for (const Key& key : keys) {
+    objects.emplace_back(key.data(), key.size());
+  }
+  for (size_t k : {size_t(1), size_t(7)}) {
+    bf::basic_bloom_filter single(0.01, keys.size(), 0, true, k, 1), bulk(0.01, keys.size(), 0, true, k, 1);
+    struct timeval start, mid, end;
+    gettimeofday(&start, NULL);
+    for (const bf::object& o : objects) {
+      single.add(o);
+    }
+    gettimeofday(&mid, NULL);
+    bulk.add_all(objects);
+    gettimeofday(&end, NULL);
+    cout << "---Bloom filter bulk insert, k = " << k << ", " << single.size() / 1024 / 1024 << "MB---\n"
+         << "add " << diffs_ms(mid, start) << "ms, add_all " << diffs_ms(end, mid) << "ms, "
+         << (single.storage() == bulk.storage() ? "same bits" : "bits differ") << '\n';
+  }
+}
+
+// a Bloom filter of R built as 4 shards on their own threads and merged, against one build
+void compareShardMerge() {
+  const size_t shards = 4;
+  bf::basic_bloom_filter whole(0.01, revoked.size(), 0, true, 7);
+  for (const Key& key : revoked) {
+    whole.add(key);
+  }
+  vector<unique_ptr<bf::basic_bloom_filter>> parts;
+  for (size_t i = 0; i < shards; i++) {
+    parts.emplace_back(new bf::basic_bloom_filter(0.01, revoked.size(), 0, true, 7));
+  }
+  struct timeval start, built, end;
+  gettimeofday(&start, NULL);
+  vector<thread> workers;
+  for (size_t i = 0; i < shards; i++) {
+    workers.emplace_back([&, i]() {
+      for (size_t j = revoked.size() * i / shards; j < revoked.size() * (i + 1) / shards; j++) {
+        parts[i]->add(revoked[j]);
+      }
+    });
+  }
+  for (thread& worker : workers) {
+    worker.join();
+  }
+  gettimeofday(&built, NULL);
+  bool merged = true;
+  for (size_t i = 1; i < shards; i++) {
+    merged = parts[0]->merge(*parts[i]) && merged;
+  }
+  gettimeofday(&end, NULL);
+  bf::basic_bloom_filter other(0.01, revoked.size(), 1, true, 7);
+  cout << "---Bloom filter of " << shards << " merged shards---\n"
+       << "build " << diffs_us(built, start) << "us, merge " << diffs_us(end, built) << "us, "
+       << (merged && parts[0]->storage() == whole.storage() ? "same bits" : "bits differ") << ", "
+       << (parts[0]->merge(other) ? "merged" : "refused") << " a filter of another seed\n"
+       << "fill ratio " << parts[0]->fill_ratio() << ", estimated FP rate " << 100 * parts[0]->estimated_fp() << "%\n";
+}
+
+void queryAll() {
+  int queryTimes = 10000000;
+  vector<int> randomIndex;
+  int totalNum = revoked.size() + stay.size();
+  
+  cout << "query " << queryTimes << " times\n";
+  
+  // generate key(index) to be queried
+  for (int i = 0; i < queryTimes; i++) {
+    randomIndex.push_back(rand() % totalNum);
+  }
+  
+  // start query
+  queryStorage("Othello", o, randomIndex);
+  queryStorage("Ribbon", r, randomIndex);
+  queryStorageBatch("Ribbon batch", r, randomIndex);
+  queryStorage("Pool", p, randomIndex);
+  queryStorage("MLBF", m, randomIndex);
+  queryStorageBatch("MLBF batch", m, randomIndex);
+  queryStorage("Frozen MLBF", f, randomIndex);
+  for (size_t inflight : {1, 8, 16, 32}) {
+    f.inflight = inflight;
+    queryStorageBatch(("Frozen MLBF batch, " + to_string(inflight) + " in flight").c_str(), f, randomIndex);
+  }
+  queryStorage("Mapped MLBF", fm, randomIndex);
+  queryStorage("Blocked MLBF", mb, randomIndex);
+  queryStorage("Fuse MLBF", mf, randomIndex);
+  queryStorage("Planned MLBF", mp, randomIndex);
+  queryStorageBatch("Planned MLBF batch", mp, randomIndex);
+  queryStorage("Planned fuse MLBF", mpf, randomIndex);
+  queryStorage("Frozen planned fuse MLBF", ff, randomIndex);
+  queryStorageBatch("Frozen planned fuse MLBF batch", ff, randomIndex);
+  queryStorage("Salt-searched MLBF", ms, randomIndex);
+  queryStorage("Exact-tail MLBF", mx, randomIndex);
+  queryStorage("Planned MLBF, CRC32-C", mc, randomIndex);
+  queryStorage("Planned MLBF, multiply-mix", mm, randomIndex);
+  // levels probed up front 1, 2 and 4 at a time or all of them, against the short-circuiting
+  // contains above
+  auto queryUpFront = [&](const char* name, MLBFStorage& s) {
+    for (size_t window : {1, 2, 4, 64}) {
+      s.upFront = window;
+      string label = string(name) + ", levels up front " + (window == 64 ? string("all at once") : to_string(window) + " at a time");
+      queryStorage(label.c_str(), s, randomIndex);
+    }
+    s.upFront = 0;
+  };
+  queryUpFront("MLBF", m);
+  queryUpFront("Blocked MLBF", mb);
+  queryUpFront("Fuse MLBF", mf);
+  queryUpFront("Planned MLBF", mp);
+  queryUpFront("Planned fuse MLBF", mpf);
+  compareHashFamilies(randomIndex);
+  compareBloomBatch(randomIndex);
+  compareBulkInsert();
+  compareShardMerge();
+}
+
 int main(int argc, char **argv) {
   // check input validity
   if (argc != 3) {